@@ -18,7 +18,9 @@ lval* builtin_op(__attribute((unused)) lenv* e, lval* a, char* op)
 		}
 	}
 
-	lval* x = lval_pop(a, 0);
+	lval* x = lval_own(lval_pop(a, 0));
+	// the number changes in place
+	x->hash = 0;
 
 	// negation
 	if ((strcmp(op, "-") == 0) && a->count == 0)
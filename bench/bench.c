@@ -0,0 +1,234 @@
+/*
+ * Benchmark driver for Phi.
+ *
+ * Runs every workload in a fresh interpreter process, first
+ * a few warmup runs that are not timed, then timed runs.
+ * Prints a table and writes median / p95 / min / max wall
+ * times in milliseconds as JSON, so runs from two commits
+ * can be compared.
+ *
+ * usage: bench [-w warmup] [-n runs] [-o out.json] [-f filter] LISP BENCHDIR
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define PARSE_LINES 20000
+
+typedef struct workload
+{
+	char* name;
+	char* file;
+	// run before every run, timed or not
+	void (*setup)(struct workload*);
+} workload;
+
+static char gen_path[4096];
+static char gen_cache[4096];
+
+static void drop_cache(__attribute__((unused)) workload* w)
+{
+	unlink(gen_cache);
+}
+
+static void keep_cache(__attribute__((unused)) workload* w) {}
+
+static workload workloads[] =
+{
+	{ "fib", "fib.phi", NULL },
+	{ "lists", "lists.phi", NULL },
+	{ "strings", "strings.phi", NULL },
+	{ "deep", "deep.phi", NULL },
+	// a large generated file of quoted data, parsed every run
+	{ "parse", NULL, drop_cache },
+	// the same file, loaded from its .phic cache
+	{ "load-cached", NULL, keep_cache },
+};
+
+#define WORKLOADS ((int)(sizeof(workloads) / sizeof(workloads[0])))
+
+static int generate(char* dir)
+{
+	snprintf(gen_path, sizeof(gen_path), "%s/parse_gen.phi", dir);
+	snprintf(gen_cache, sizeof(gen_cache), "%s/parse_gen.phic", dir);
+
+	FILE* f = fopen(gen_path, "w");
+	if (!f) { return 0; }
+
+	for (int i = 0; i < PARSE_LINES; i++)
+	{
+		fprintf(f, "; record %d\n", i);
+		fprintf(f, "{r%d %d -%d \"line %d\\n\" {nested {deeper sym-%d}} (+ %d 1)}\n",
+			i, i, i * 7, i, i % 97, i);
+	}
+	return fclose(f) == 0;
+}
+
+static double now_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+// run LISP FILE with output discarded, -1 if it could not run
+static double run_once(char* lisp, char* file)
+{
+	double start = now_ms();
+
+	pid_t pid = fork();
+	if (pid < 0) { return -1; }
+
+	if (pid == 0)
+	{
+		int null = open("/dev/null", O_WRONLY);
+		if (null >= 0)
+		{
+			dup2(null, STDOUT_FILENO);
+			dup2(null, STDERR_FILENO);
+		}
+		execl(lisp, lisp, file, (char*) NULL);
+		_exit(127);
+	}
+
+	int status;
+	if (waitpid(pid, &status, 0) < 0) { return -1; }
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) { return -1; }
+
+	return now_ms() - start;
+}
+
+static int cmp_double(const void* a, const void* b)
+{
+	double x = *(const double*) a;
+	double y = *(const double*) b;
+	return (x > y) - (x < y);
+}
+
+// nearest rank percentile of sorted times
+static double percentile(double* t, int n, double p)
+{
+	int i = (int)(p * n + 0.999999) - 1;
+	if (i < 0) { i = 0; }
+	if (i >= n) { i = n - 1; }
+	return t[i];
+}
+
+int main(int argc, char** argv)
+{
+	int warmup = 2;
+	int runs = 10;
+	char* out = NULL;
+	char* filter = NULL;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "w:n:o:f:")) != -1)
+	{
+		switch (opt)
+		{
+			case 'w': warmup = atoi(optarg); break;
+			case 'n': runs = atoi(optarg); break;
+			case 'o': out = optarg; break;
+			case 'f': filter = optarg; break;
+			default:
+				fprintf(stderr, "usage: %s [-w warmup] [-n runs] [-o out.json] [-f filter] LISP BENCHDIR\n", argv[0]);
+				return 1;
+		}
+	}
+
+	if (argc - optind != 2 || runs < 1 || warmup < 0)
+	{
+		fprintf(stderr, "usage: %s [-w warmup] [-n runs] [-o out.json] [-f filter] LISP BENCHDIR\n", argv[0]);
+		return 1;
+	}
+
+	char* lisp = argv[optind];
+	char* dir = argv[optind + 1];
+
+	char tmp[] = "/tmp/phi-bench-XXXXXX";
+	if (!mkdtemp(tmp) || !generate(tmp))
+	{
+		fprintf(stderr, "Could not generate the parse workload\n");
+		return 1;
+	}
+
+	FILE* json = out ? fopen(out, "w") : NULL;
+	if (out && !json)
+	{
+		fprintf(stderr, "Could not write %s\n", out);
+		return 1;
+	}
+	if (json) { fprintf(json, "{\n  \"warmup\": %d,\n  \"runs\": %d,\n  \"results\": [", warmup, runs); }
+
+	printf("%-12s %10s %10s %10s %10s\n", "workload", "median", "p95", "min", "max");
+
+	double* times = malloc(sizeof(double) * runs);
+	int failed = 0;
+	int written = 0;
+
+	for (int i = 0; i < WORKLOADS; i++)
+	{
+		workload* w = &workloads[i];
+		if (filter && !strstr(w->name, filter)) { continue; }
+
+		char file[4096];
+		if (w->file)
+		{
+			snprintf(file, sizeof(file), "%s/%s", dir, w->file);
+		} else {
+			snprintf(file, sizeof(file), "%s", gen_path);
+		}
+
+		int ok = 1;
+		for (int r = 0; r < warmup + runs && ok; r++)
+		{
+			if (w->setup) { w->setup(w); }
+			double t = run_once(lisp, file);
+			if (t < 0) { ok = 0; }
+			if (r >= warmup) { times[r - warmup] = t; }
+		}
+
+		if (!ok)
+		{
+			printf("%-12s %10s\n", w->name, "failed");
+			failed = 1;
+			continue;
+		}
+
+		qsort(times, runs, sizeof(double), cmp_double);
+		double median = runs % 2 ? times[runs / 2]
+			: (times[runs / 2 - 1] + times[runs / 2]) / 2;
+		double p95 = percentile(times, runs, 0.95);
+
+		printf("%-12s %8.2fms %8.2fms %8.2fms %8.2fms\n",
+			w->name, median, p95, times[0], times[runs - 1]);
+
+		if (json)
+		{
+			fprintf(json, "%s\n    {\"name\": \"%s\", \"median_ms\": %.3f, \"p95_ms\": %.3f, "
+				"\"min_ms\": %.3f, \"max_ms\": %.3f}",
+				written++ ? "," : "", w->name, median, p95, times[0], times[runs - 1]);
+		}
+	}
+
+	if (json)
+	{
+		fprintf(json, "\n  ]\n}\n");
+		fclose(json);
+	}
+
+	free(times);
+	unlink(gen_cache);
+	unlink(gen_path);
+	rmdir(tmp);
+
+	return failed;
+}
@@ -0,0 +1,357 @@
+/*
+ * Microbenchmarks for the interpreter components.
+ *
+ * Links against the interpreter objects (everything but
+ * main.o) and times lval, lenv and parser operations in
+ * isolation. Each case is calibrated to run for at least
+ * MICRO_MIN_MS and reports ns per operation, plus cycles
+ * per operation where the TSC is available.
+ *
+ * usage: microbench [filter]
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "mpc.h"
+#include "lval.h"
+#include "lenv.h"
+#include "expressions.h"
+#include "semantics.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define MICRO_TSC 1
+#else
+#define MICRO_TSC 0
+#endif
+
+#define MICRO_MIN_MS 100.0
+
+typedef void (*micro_fn)(void*, long);
+
+static char* filter = NULL;
+
+static double now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static unsigned long long cycles(void)
+{
+#if MICRO_TSC
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+/*
+ * Run fn(arg, iters) with iters doubling until it takes
+ * long enough, then report the last run per operation.
+ * ops is how many operations one iteration stands for.
+ */
+static void micro_run(char* name, micro_fn fn, void* arg, long ops)
+{
+	if (filter && !strstr(name, filter)) { return; }
+
+	long iters = 1;
+	double ns;
+	unsigned long long cyc;
+
+	while (1)
+	{
+		double start = now_ns();
+		unsigned long long c0 = cycles();
+		fn(arg, iters);
+		cyc = cycles() - c0;
+		ns = now_ns() - start;
+
+		if (ns >= MICRO_MIN_MS * 1e6 || iters >= (1L << 40)) { break; }
+		iters *= 2;
+	}
+
+	double n = (double) iters * ops;
+	if (MICRO_TSC)
+	{
+		printf("%-36s %12.2f ns/op %12.1f cycles/op %10ld ops\n", name, ns / n, cyc / n, (long) n);
+	} else {
+		printf("%-36s %12.2f ns/op %10ld ops\n", name, ns / n, (long) n);
+	}
+}
+
+/*
+ * Tree shapes
+ */
+
+static lval* tree_flat(int n)
+{
+	lval* x = lval_qexpr();
+	for (int i = 0; i < n; i++) { x = lval_add(x, lval_num(i)); }
+	return x;
+}
+
+static lval* tree_deep(int n)
+{
+	lval* x = lval_qexpr();
+	for (int i = 0; i < n; i++)
+	{
+		x = lval_add(lval_add(lval_qexpr(), lval_sym("node")), x);
+	}
+	return x;
+}
+
+static lval* tree_binary(int depth)
+{
+	if (depth == 0) { return lval_str("leaf"); }
+	lval* x = lval_sexpr();
+	x = lval_add(x, tree_binary(depth - 1));
+	x = lval_add(x, tree_binary(depth - 1));
+	return x;
+}
+
+static int tree_size(lval* v)
+{
+	int n = 1;
+	if (v->type == LVAL_SEXPR || v->type == LVAL_QEXPR)
+	{
+		for (int i = 0; i < v->count; i++) { n += tree_size(v->cell[i]); }
+	}
+	return n;
+}
+
+/*
+ * lval_copy / lval_del
+ */
+
+static void copy_del(void* arg, long iters)
+{
+	for (long i = 0; i < iters; i++) { lval_del(lval_copy(arg)); }
+}
+
+static void bench_copy(void)
+{
+	struct { char* name; lval* tree; } trees[] =
+	{
+		{ "copy+del flat 1000 nums", tree_flat(1000) },
+		{ "copy+del deep 200 nested", tree_deep(200) },
+		{ "copy+del binary depth 10", tree_binary(10) },
+	};
+
+	for (int i = 0; i < 3; i++)
+	{
+		// per node, so the shapes can be compared
+		micro_run(trees[i].name, copy_del, trees[i].tree, tree_size(trees[i].tree));
+		lval_del(trees[i].tree);
+	}
+}
+
+/*
+ * lenv_get
+ * The symbol looked up is the last one bound in the outermost
+ * env, so every lookup walks the whole chain and every table.
+ */
+
+typedef struct
+{
+	lenv* inner;
+	lval* key;
+} env_case;
+
+static void env_get(void* arg, long iters)
+{
+	env_case* c = arg;
+	for (long i = 0; i < iters; i++) { lval_del(lenv_get(c->inner, c->key)); }
+}
+
+static void bench_env(void)
+{
+	int depths[] = { 1, 4, 16, 64 };
+	int sizes[] = { 8, 64, 512 };
+	char sym[32];
+
+	for (int d = 0; d < 4; d++)
+	{
+		for (int s = 0; s < 3; s++)
+		{
+			lenv* outer = lenv_new();
+			lenv* inner = outer;
+
+			for (int level = 0; level < depths[d]; level++)
+			{
+				if (level > 0)
+				{
+					lenv* e = lenv_new();
+					e->par = inner;
+					inner = e;
+				}
+				for (int i = 0; i < sizes[s]; i++)
+				{
+					snprintf(sym, sizeof(sym), "sym-%d-%d", level, i);
+					lval* k = lval_sym(sym);
+					lval* v = lval_num(i);
+					lenv_put(inner, k, v);
+					lval_del(k); lval_del(v);
+				}
+			}
+
+			snprintf(sym, sizeof(sym), "sym-0-%d", sizes[s] - 1);
+			env_case c = { inner, lval_sym(sym) };
+			char name[64];
+			snprintf(name, sizeof(name), "lenv_get depth %d size %d", depths[d], sizes[s]);
+			micro_run(name, env_get, &c, 1);
+			lval_del(c.key);
+
+			while (inner)
+			{
+				lenv* par = inner->par;
+				lenv_del(inner);
+				inner = par;
+			}
+		}
+	}
+}
+
+/*
+ * lval_add / lval_pop
+ */
+
+static void add_pop_front(void* arg, long iters)
+{
+	int n = *(int*) arg;
+	for (long i = 0; i < iters; i++)
+	{
+		lval* x = tree_flat(n);
+		while (x->count) { lval_del(lval_pop(x, 0)); }
+		lval_del(x);
+	}
+}
+
+static void add_pop_back(void* arg, long iters)
+{
+	int n = *(int*) arg;
+	for (long i = 0; i < iters; i++)
+	{
+		lval* x = tree_flat(n);
+		while (x->count) { lval_del(lval_pop(x, x->count - 1)); }
+		lval_del(x);
+	}
+}
+
+static void bench_add_pop(void)
+{
+	int sizes[] = { 16, 1000 };
+	char name[64];
+
+	for (int s = 0; s < 2; s++)
+	{
+		snprintf(name, sizeof(name), "add+pop front %d", sizes[s]);
+		micro_run(name, add_pop_front, &sizes[s], sizes[s]);
+		snprintf(name, sizeof(name), "add+pop back %d", sizes[s]);
+		micro_run(name, add_pop_back, &sizes[s], sizes[s]);
+	}
+}
+
+/*
+ * lval_eq
+ */
+
+typedef struct
+{
+	lval* x;
+	lval* y;
+} eq_case;
+
+static volatile int eq_sink;
+
+static void eq(void* arg, long iters)
+{
+	eq_case* c = arg;
+	for (long i = 0; i < iters; i++) { eq_sink = lval_eq(c->x, c->y); }
+}
+
+static void bench_eq(void)
+{
+	lval* x = tree_binary(13);
+	eq_case c = { x, lval_copy(x) };
+	micro_run("lval_eq binary depth 13", eq, &c, tree_size(x));
+	lval_del(c.x);
+	lval_del(c.y);
+}
+
+/*
+ * mpc_parse + lval_read
+ */
+
+typedef struct
+{
+	mpc_parser_t* phi;
+	char* input;
+} parse_case;
+
+static void parse(void* arg, long iters)
+{
+	parse_case* c = arg;
+	for (long i = 0; i < iters; i++)
+	{
+		mpc_result_t r;
+		if (mpc_parse("<micro>", c->input, c->phi, &r))
+		{
+			lval_del(lval_read(r.output));
+			mpc_ast_delete(r.output);
+		} else {
+			mpc_err_print(r.error);
+			mpc_err_delete(r.error);
+			exit(1);
+		}
+	}
+}
+
+static void bench_parse(void)
+{
+	if (filter && !strstr("parse+read", filter)) { return; }
+
+	parser_elements* elements = get_parser();
+
+	size_t cap = 1 << 20;
+	char* input = malloc(cap);
+	size_t len = 0;
+	for (int i = 0; len + 256 < cap; i++)
+	{
+		len += sprintf(input + len,
+			"; record %d\n(def {r%d} {%d -%d \"line %d\\n\" {nested {deeper sym-%d}}})\n",
+			i, i, i, i * 7, i, i % 97);
+	}
+
+	parse_case c = { elements->Phi, input };
+
+	// throughput per byte, reported as MB/s as well
+	double start = now_ns();
+	parse(&c, 5);
+	double mbs = 5.0 * len / ((now_ns() - start) / 1e9) / 1e6;
+
+	micro_run("parse+read per byte", parse, &c, len);
+	printf("%-36s %12.2f MB/s\n", "parse+read throughput", mbs);
+
+	free(input);
+	free_parsers(elements);
+}
+
+int main(int argc, char** argv)
+{
+	if (argc > 1) { filter = argv[1]; }
+
+	bench_copy();
+	bench_env();
+	bench_add_pop();
+	bench_eq();
+	bench_parse();
+
+	return 0;
+}
@@ -9,6 +9,20 @@
 #include "ordering.h"
 #include "mpc.h"
 #include "semantics.h"
+#include "serialize.h"
+#include "profile.h"
+#include "stats.h"
+#include "memo.h"
+#include "map.h"
+#include "hamt.h"
+#include "omap.h"
+#include "pqueue.h"
+#include "vec.h"
+#include "sort.h"
+#include "str.h"
+#include "print.h"
+#include "file.h"
+#include "csv.h"
 
 #include "builtins.h"
 
@@ -55,28 +69,34 @@ lval* builtin_if(__attribute__((unused)) lenv* e, lval* a)
 
 	lval_del(a);
 
+	// the codepaths may be shared with a function body,
+	// so they are evaluated in place rather than consumed
 	if (condition->type == LVAL_QEXPR)
 	{
-		condition->type = LVAL_SEXPR;
-		lval* condition_evaled = lval_eval(e, condition);
+		lval* condition_evaled = lval_eval_body(e, condition);
+		lval_del(condition);
 		if (!(condition_evaled->type == LVAL_BOOL))
 		{
 			lval_del(condition_evaled);
+			lval_del(true_codepath);
+			lval_del(false_codepath);
 			return lval_err("Expected if condition to evaluate to a bool, it didn't");
 		}
 		condition = condition_evaled;
 	}
 
-	if (condition->bool_state == TRUE)
+	lval* codepath = condition->bool_state == TRUE ? true_codepath : false_codepath;
+	lval_del(condition);
+	lval_del(codepath == true_codepath ? false_codepath : true_codepath);
+
+	if (codepath->type != LVAL_QEXPR)
 	{
-		lval_del(condition);
-		if (true_codepath->type == LVAL_QEXPR) true_codepath->type = LVAL_SEXPR;
-		return lval_eval(e, true_codepath);
+		return lval_eval(e, codepath);
 	}
 
-	lval_del(condition);
-	if (true_codepath->type == LVAL_QEXPR) false_codepath->type = LVAL_SEXPR;
-	return lval_eval(e, false_codepath);
+	lval* result = lval_eval_body(e, codepath);
+	lval_del(codepath);
+	return result;
 }
 
 lval* builtin_var(lenv* e, lval* a, char* func)
@@ -98,6 +118,13 @@ lval* builtin_var(lenv* e, lval* a, char* func)
 		
 		for (int i = 0; i < syms->count; i++)
 		{
+			// functions are known by the first name they are bound to
+			lval* v = a->cell[i+1];
+			if (v->type == LVAL_FUN && !v->name)
+			{
+				v->name = profile_intern(syms->cell[i]->sym);
+			}
+
 			if (strcmp(func, "def") == 0)
 			{
 				lenv_def(e, syms->cell[i], a->cell[i+1]);
@@ -140,94 +167,186 @@ lval* builtin_eval(lenv* e, lval* a)
 	LASSERT(a, a->cell[0]->type == LVAL_QEXPR, "Function 'eval' passed incorrect type!");
 
 	lval* x = lval_take(a, 0);
-	x->type = LVAL_SEXPR;
-	return lval_eval(e, x);
+	lval* result = lval_eval_body(e, x);
+	lval_del(x);
+	return result;
+}
+
+static lval* lval_call_frame(lenv* e, lval* f, lval* a, int owned);
+
+/*
+ * owned is set when the caller lets go of f right after the
+ * call, so nothing it holds sees f change. Builtins that
+ * call a function from their arguments again and again,
+ * like fold or sort, keep it and go through lval_call.
+ */
+static lval* lval_invoke(lenv* e, lval* f, lval* a, int owned)
+{
+	STATS_INC(calls);
+	if (f->builtin) { STATS_INC(builtin_calls); }
+
+	if (!profile_enabled)
+	{
+		return lval_call_frame(e, f, a, owned);
+	}
+
+	profile_push(f->name);
+	lval* result = lval_call_frame(e, f, a, owned);
+	profile_pop();
+	return result;
 }
 
 lval* lval_call(lenv* e, lval* f, lval* a)
+{
+	return lval_invoke(e, f, a, 0);
+}
+
+// number of arguments a lambda needs before its body can run
+static int lval_arity(lval* f)
+{
+	for (int i = 0; i < f->formals->count; i++)
+	{
+		if (strcmp(f->formals->cell[i]->sym, "&") == 0) { return i; }
+	}
+	return f->formals->count;
+}
+
+/*
+ * Applying a partial puts its bound arguments in front of
+ * the new ones. While arguments are still missing, a
+ * partial the caller gives up and nobody else holds is
+ * extended in place.
+ */
+static lval* lval_call_partial(lenv* e, lval* p, lval* a, int owned)
+{
+	if (p->count + a->count < lval_arity(p->fn))
+	{
+		lval* x = owned && p->refs == 1 ? lval_ref(p) : lval_partial(lval_ref(p->fn));
+
+		if (x != p)
+		{
+			x->cell = malloc(sizeof(lval*) * (p->count + a->count));
+			for (int i = 0; i < p->count; i++)
+			{
+				x->cell[x->count++] = lval_ref(p->cell[i]);
+			}
+		} else {
+			x->cell = realloc(x->cell, sizeof(lval*) * (p->count + a->count));
+		}
+
+		for (int i = 0; i < a->count; i++)
+		{
+			x->cell[x->count++] = a->cell[i];
+		}
+		x->hash = 0;
+
+		a->count = 0;
+		lval_del(a);
+		return x;
+	}
+
+	a->cell = realloc(a->cell, sizeof(lval*) * (p->count + a->count));
+	memmove(&a->cell[p->count], &a->cell[0], sizeof(lval*) * a->count);
+	for (int i = 0; i < p->count; i++)
+	{
+		a->cell[i] = lval_ref(p->cell[i]);
+	}
+	a->count += p->count;
+	a->hash = 0;
+
+	return lval_call_frame(e, p->fn, a, 0);
+}
+
+static lval* lval_call_frame(lenv* e, lval* f, lval* a, int owned)
 {
 	if (f->builtin)
 	{ return f->builtin(e, a);}
 
+	if (f->memo)
+	{ return lval_call_memo(e, f, a); }
+
+	if (f->fn)
+	{ return lval_call_partial(e, f, a, owned); }
+
 	int given = a->count;
 	int total = f->formals->count;
 
+	// not all formals can be substituted, return a partial
+	if (given < lval_arity(f))
+	{
+		lval* partial = lval_partial(lval_ref(f));
+		partial->cell = a->cell;
+		partial->count = a->count;
+
+		a->cell = NULL;
+		a->count = 0;
+		lval_del(a);
+		return partial;
+	}
+
+	// lambdas are shared and never change, the arguments
+	// are bound in a new frame for this call
+	lenv* frame = lenv_new();
+
+	// index of the next formal to bind
+	int next = 0;
+
 	while (a->count)
 	{
-		if (f->formals->count == 0)
+		if (next == total)
 		{
+			lenv_del(frame);
 			lval_del(a);
 			return lval_err(
 				"Function passed too many arguemnts. "
 				"Got %i, expected %i.", given, total);
 		}
 
-		lval* sym = lval_pop(f->formals, 0);
+		lval* sym = f->formals->cell[next++];
 
 		if (strcmp(sym->sym, "&") == 0)
 		{
-			if (f->formals->count != 1)
+			if (next != total - 1)
 			{
+				lenv_del(frame);
 				lval_del(a);
 				return lval_err("Function format invalid. "
 					"Symbol '&' not followed by single symbol.");
 			}
 
-			lval* nsym = lval_pop(f->formals, 0);
-			lenv_put(f->env, nsym, builtin_list(e, a));
-			lval_del(sym); lval_del(nsym);
+			lenv_bind(frame, f->formals->cell[next++]->sym, builtin_list(e, a));
+			a = NULL;
 			break;
 		}
 
-		lval* val = lval_pop(a, 0);
-
-		lenv_put(f->env, sym, val);
-
-		lval_del(sym); lval_del(val);
+		lenv_bind(frame, sym->sym, lval_pop(a, 0));
 	}
 
-	lval_del(a);
+	if (a) { lval_del(a); }
 
 	// variable arguments similar to *args in python
-	if (f->formals->count > 0 && strcmp(f->formals->cell[0]->sym, "&") == 0)
+	if (next < total && strcmp(f->formals->cell[next]->sym, "&") == 0)
 	{
-		if (f->formals->count != 2)
+		if (total - next != 2)
 		{
+			lenv_del(frame);
 			return lval_err("Function format invalid. "
 				"Symbol '&' not followed by single symbol.");
 		}
 
-		lval_del(lval_pop(f->formals, 0));
-
-		lval* sym = lval_pop(f->formals, 0);
-		lval* val = lval_qexpr();
-
-		lenv_put(f->env, sym, val);
-		lval_del(sym); lval_del(val);
-	}
-
-	if (f->formals->count == 0)
-	{
-		// all formals have been substituted, eval the function and return
-		f->env->par = e;
-
-		return builtin_eval(
-			f->env, lval_add(lval_sexpr(), lval_copy(f->body)));
-	} else {
-		// not all formals have been substituted, return a partial
-		return lval_copy(f);
+		lenv_bind(frame, f->formals->cell[next+1]->sym, lval_qexpr());
 	}
 
+	// all formals have been substituted, eval the function and return
+	frame->par = e;
+	lval* result = lval_eval_body(frame, f->body);
+	lenv_del(frame);
+	return result;
 }
 
-lval* lval_eval_sexpr(lenv* env, lval* v)
+// v holds evaluated values, call the first one on the rest
+lval* lval_apply(lenv* env, lval* v)
 {
-
-	for (int i = 0; i < v->count; i++)
-	{
-		v->cell[i] = lval_eval(env, v->cell[i]);
-	}
-
 	for (int i = 0; i < v->count; i++)
 	{
 		if (v->cell[i]->type == LVAL_ERR)
@@ -259,11 +378,55 @@ lval* lval_eval_sexpr(lenv* env, lval* v)
 		return err;
 	}
 
-	lval* result = lval_call(env, f, v);
+	lval* result = lval_invoke(env, f, v, 1);
 	lval_del(f);
 	return result;
 }
 
+lval* lval_eval_sexpr(lenv* env, lval* v)
+{
+	v->hash = 0;
+	for (int i = 0; i < v->count; i++)
+	{
+		v->cell[i] = lval_eval(env, v->cell[i]);
+	}
+
+	return lval_apply(env, v);
+}
+
+/*
+ * Evaluation that leaves v untouched, for code that is
+ * shared such as function bodies. Anything that is not
+ * evaluated is shared into the result instead of copied.
+ */
+lval* lval_eval_ref(lenv* env, lval* v)
+{
+	if (v->type == LVAL_SYM)
+	{
+		return lenv_get(env, v);
+	}
+	if (v->type == LVAL_SEXPR)
+	{
+		return lval_eval_body(env, v);
+	}
+	return lval_ref(v);
+}
+
+// evaluates the s- or q-expression v as an s-expression, v is left untouched
+lval* lval_eval_body(lenv* env, lval* v)
+{
+	lval* x = lval_sexpr();
+	x->count = v->count;
+	x->cell = malloc(sizeof(lval*) * v->count);
+
+	for (int i = 0; i < v->count; i++)
+	{
+		x->cell[i] = lval_eval_ref(env, v->cell[i]);
+	}
+
+	return lval_apply(env, x);
+}
+
 lval* lval_eval(lenv* env, lval* v)
 {
 	if (v->type == LVAL_SYM)
@@ -274,6 +437,13 @@ lval* lval_eval(lenv* env, lval* v)
 	}
 	if (v->type == LVAL_SEXPR)
 	{
+		// shared code, interned by --hash-cons for one, is left as it is
+		if (v->refs > 1)
+		{
+			lval* x = lval_eval_body(env, v);
+			lval_del(v);
+			return x;
+		}
 		return lval_eval_sexpr(env, v);
 	}
 	return v;
@@ -284,47 +454,72 @@ lval* builtin_load(lenv* e, lval* a)
 	LASSERT_NUM("load", a, 1);
 	LASSERT_TYPE("load", a, 0, LVAL_STR);
 
-	mpc_result_t r;
-	if (mpc_parse_contents(a->cell[0]->str, e->phi, &r))
-	{
-		lval* expr = lval_read(r.output);
-		mpc_ast_delete(r.output);
+	// only the global env holds the parser
+	lenv* root = e;
+	while (root->par) { root = root->par; }
 
-		while (expr->count)
+	// prefer the precompiled module, parse and cache it otherwise
+	lval* expr = lval_cache_enabled ? lval_cache_load(lval_cstr(a->cell[0])) : NULL;
+
+	if (!expr)
+	{
+		mpc_result_t r;
+		if (!mpc_parse_contents(a->cell[0]->str, root->phi, &r))
 		{
-			lval* x = lval_eval(e, lval_pop(expr, 0));
+			char* err_msg = mpc_err_string(r.error);
+			mpc_err_delete(r.error);
 
-			if (x->type == LVAL_ERR)
-			{
-				lval_println(x);
-			}
-			lval_del(x);
+			lval* err = lval_err("Could not load library %s", err_msg);
+			free(err_msg);
+			lval_del(a);
+
+			return err;
 		}
 
-		lval_del(expr);
-		lval_del(a);
+		expr = lval_read(r.output);
+		mpc_ast_delete(r.output);
 
-		return lval_sexpr();
-	} else {
-		char* err_msg = mpc_err_string(r.error);
-		mpc_err_delete(r.error);
+		if (lval_cache_enabled) { lval_cache_store(a->cell[0]->str, expr); }
+	}
 
-		lval* err = lval_err("Could not load library %s", err_msg);
-		free(err_msg);
-		lval_del(a);
+	if (lval_hash_cons)
+	{
+		for (int i = 0; i < expr->count; i++)
+		{
+			expr->cell[i] = lval_intern(expr->cell[i]);
+		}
+	}
 
-		return err;
+	while (expr->count)
+	{
+		lval* x = lval_eval(e, lval_pop(expr, 0));
+
+		if (x->type == LVAL_ERR)
+		{
+			lval_println(x);
+		}
+		lval_del(x);
 	}
+
+	lval_del(expr);
+	lval_del(a);
+
+	return lval_sexpr();
 }
 
 lval* builtin_print(__attribute__((unused)) lenv* e, lval* a)
 {
+	// one buffer for the whole line
+	sbuf b = { NULL, 0, 0 };
 	for (int i = 0; i < a->count; i++)
 	{
-		lval_print(a->cell[i]); putchar(' ');
+		lval_write(&b, a->cell[i], stdout);
+		sbuf_put_u8(&b, ' ');
 	}
 
-	putchar('\n');
+	sbuf_put_u8(&b, '\n');
+	sbuf_flush(&b, stdout);
+	free(b.data);
 	lval_del(a);
 
 	return lval_sexpr();
@@ -335,7 +530,7 @@ lval* builtin_error(__attribute__((unused)) lenv* e, lval* a)
 	LASSERT_NUM("error", a, 1);
 	LASSERT_TYPE("error", a, 0, LVAL_STR);
 
-	lval* err = lval_err(a->cell[0]->str);
+	lval* err = lval_err(lval_cstr(a->cell[0]));
 
 	lval_del(a);
 	return err;
@@ -345,6 +540,7 @@ void lenv_add_builtin_fun(lenv* env, char* name, lbuiltin func)
 {
 	lval* k = lval_sym(name);
 	lval* v = lval_fun(func);
+	v->name = profile_intern(name);
 	lenv_put(env, k, v);
 	lval_del(k); lval_del(v);
 }
@@ -391,5 +587,70 @@ void lenv_add_builtins(lenv* e)
 	lenv_add_builtin_fun(e, "load", builtin_load);
 	lenv_add_builtin_fun(e, "error", builtin_error);
 	lenv_add_builtin_fun(e, "print", builtin_print);
+	lenv_add_builtin_fun(e, "print-to-string", builtin_print_to_string);
+	lenv_add_builtin_fun(e, "stats", builtin_stats);
+
+	lenv_add_builtin_fun(e, "memo", builtin_memo);
+	lenv_add_builtin_fun(e, "memo-stats", builtin_memo_stats);
+
+	lenv_add_builtin_fun(e, "map-new", builtin_map_new);
+	lenv_add_builtin_fun(e, "map-get", builtin_map_get);
+	lenv_add_builtin_fun(e, "map-put", builtin_map_put);
+	lenv_add_builtin_fun(e, "map-del", builtin_map_del);
+	lenv_add_builtin_fun(e, "map-keys", builtin_map_keys);
+	lenv_add_builtin_fun(e, "map-count", builtin_map_count);
+
+	lenv_add_builtin_fun(e, "hamt-new", builtin_hamt_new);
+	lenv_add_builtin_fun(e, "hamt-get", builtin_hamt_get);
+	lenv_add_builtin_fun(e, "hamt-put", builtin_hamt_put);
+	lenv_add_builtin_fun(e, "hamt-del", builtin_hamt_del);
+	lenv_add_builtin_fun(e, "hamt-keys", builtin_hamt_keys);
+	lenv_add_builtin_fun(e, "hamt-items", builtin_hamt_items);
+	lenv_add_builtin_fun(e, "hamt-count", builtin_hamt_count);
+	lenv_add_builtin_fun(e, "hamt-fold", builtin_hamt_fold);
+
+	lenv_add_builtin_fun(e, "omap-new", builtin_omap_new);
+	lenv_add_builtin_fun(e, "omap-get", builtin_omap_get);
+	lenv_add_builtin_fun(e, "omap-put", builtin_omap_put);
+	lenv_add_builtin_fun(e, "omap-del", builtin_omap_del);
+	lenv_add_builtin_fun(e, "omap-range", builtin_omap_range);
+	lenv_add_builtin_fun(e, "omap-floor", builtin_omap_floor);
+	lenv_add_builtin_fun(e, "omap-ceil", builtin_omap_ceil);
+	lenv_add_builtin_fun(e, "omap-keys", builtin_omap_keys);
+	lenv_add_builtin_fun(e, "omap-items", builtin_omap_items);
+	lenv_add_builtin_fun(e, "omap-count", builtin_omap_count);
+
+	lenv_add_builtin_fun(e, "pq-new", builtin_pq_new);
+	lenv_add_builtin_fun(e, "pq-push", builtin_pq_push);
+	lenv_add_builtin_fun(e, "pq-pop", builtin_pq_pop);
+	lenv_add_builtin_fun(e, "pq-peek", builtin_pq_peek);
+	lenv_add_builtin_fun(e, "pq-count", builtin_pq_count);
+
+	lenv_add_builtin_fun(e, "vec-new", builtin_vec_new);
+	lenv_add_builtin_fun(e, "vec-get", builtin_vec_get);
+	lenv_add_builtin_fun(e, "vec-count", builtin_vec_count);
+	lenv_add_builtin_fun(e, "vec-sum", builtin_vec_sum);
+	lenv_add_builtin_fun(e, "vec->list", builtin_vec_to_list);
+
+	lenv_add_builtin_fun(e, "sort", builtin_sort);
+	lenv_add_builtin_fun(e, "sort-by", builtin_sort_by);
+
+	lenv_add_builtin_fun(e, "str-len", builtin_str_len);
+	lenv_add_builtin_fun(e, "str-cat", builtin_str_cat);
+	lenv_add_builtin_fun(e, "substr", builtin_substr);
+	lenv_add_builtin_fun(e, "str-find", builtin_str_find);
+	lenv_add_builtin_fun(e, "str-split", builtin_str_split);
+	lenv_add_builtin_fun(e, "str->num", builtin_str_to_num);
+	lenv_add_builtin_fun(e, "num->str", builtin_num_to_str);
+
+	lenv_add_builtin_fun(e, "file-open", builtin_file_open);
+	lenv_add_builtin_fun(e, "file-close", builtin_file_close);
+	lenv_add_builtin_fun(e, "read-line", builtin_read_line);
+	lenv_add_builtin_fun(e, "read-all", builtin_read_all);
+	lenv_add_builtin_fun(e, "write", builtin_write);
+	lenv_add_builtin_fun(e, "flush", builtin_flush);
+	lenv_add_builtin_fun(e, "fold-lines", builtin_fold_lines);
+	lenv_add_builtin_fun(e, "mmap-file", builtin_mmap_file);
+	lenv_add_builtin_fun(e, "read-csv", builtin_read_csv);
 }
 
@@ -11,6 +11,9 @@ lval* builtin_load(lenv*, lval*);
 lval* lval_call(lenv*, lval*, lval*);
 lval* lval_eval(lenv*, lval*);
 lval* lval_eval_sexpr(lenv*, lval*);
+lval* lval_apply(lenv*, lval*);
+lval* lval_eval_ref(lenv*, lval*);
+lval* lval_eval_body(lenv*, lval*);
 lval* lval_eval(lenv*, lval*);
 void lenv_add_builtins(lenv*);
 
@@ -0,0 +1,373 @@
+#include "lval.h"
+#include "lenv.h"
+#include "csv.h"
+#include "file.h"
+#include "vec.h"
+#include "builtins.h"
+#include "expressions.h"
+#include "common.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// bytes [start, start + len) of the input, without the quotes around them
+typedef struct csv_field
+{
+	long start;
+	long len;
+	// quoted, with "" inside standing for a quote
+	int escaped;
+} csv_field;
+
+// fields of the row last read, reused from one row to the next
+typedef struct csv_row
+{
+	csv_field* fields;
+	int count;
+	int cap;
+} csv_row;
+
+typedef struct csv_col
+{
+	// the cells while all of them are numbers, NULL after
+	long* nums;
+	// the cells as strings, once one of them is not a number
+	lval** strs;
+	long count;
+	long cap;
+} csv_col;
+
+// bytes that end an unquoted field
+static const unsigned char csv_stop[256] = { [','] = 1, ['\n'] = 1, ['\r'] = 1 };
+
+/*
+ * Reads the row at *pos into row and moves *pos past it and
+ * its line break. Returns 0 when a quote is not closed, or
+ * its field goes on after the closing one.
+ */
+static int csv_read_row(char* s, long n, long* pos, csv_row* row)
+{
+	long i = *pos;
+	row->count = 0;
+	while (1)
+	{
+		if (row->count == row->cap)
+		{
+			row->cap = row->cap ? row->cap * 2 : 16;
+			row->fields = realloc(row->fields, sizeof(csv_field) * row->cap);
+		}
+		csv_field* f = &row->fields[row->count++];
+		f->escaped = 0;
+
+		if (i < n && s[i] == '"')
+		{
+			f->start = ++i;
+			while (1)
+			{
+				char* q = memchr(s + i, '"', n - i);
+				if (!q) { return 0; }
+				i = q - s + 1;
+				if (i < n && s[i] == '"')
+				{
+					f->escaped = 1;
+					i++;
+					continue;
+				}
+				break;
+			}
+			f->len = i - 1 - f->start;
+			if (i < n && !csv_stop[(unsigned char) s[i]]) { return 0; }
+		} else {
+			f->start = i;
+			while (i < n && !csv_stop[(unsigned char) s[i]]) { i++; }
+			f->len = i - f->start;
+		}
+
+		if (i < n && s[i] == ',')
+		{
+			i++;
+			continue;
+		}
+		break;
+	}
+
+	if (i < n && s[i] == '\r') { i++; }
+	if (i < n && s[i] == '\n') { i++; }
+	*pos = i;
+	return 1;
+}
+
+/*
+ * Whether the field is a number written the way num->str
+ * writes it, so reading it as one loses nothing: digits
+ * after an optional -, without leading zeros or spaces.
+ */
+static int csv_num(char* s, csv_field* f, long* x)
+{
+	char buf[24];
+	char* p = s + f->start;
+	if (f->escaped || f->len == 0 || f->len >= (long) sizeof(buf)) { return 0; }
+
+	long i = p[0] == '-';
+	if (i == f->len || (p[i] == '0' && (i || f->len > 1))) { return 0; }
+	for (long j = i; j < f->len; j++)
+	{
+		if (p[j] < '0' || p[j] > '9') { return 0; }
+	}
+
+	memcpy(buf, p, f->len);
+	buf[f->len] = '\0';
+	char* end;
+	errno = 0;
+	*x = strtol(buf, &end, 10);
+	return *end == '\0' && errno != ERANGE;
+}
+
+static lval* csv_str(lval* src, csv_field* f)
+{
+	if (!f->escaped)
+	{
+		return lval_str_view(src, f->start, f->len);
+	}
+
+	char* s = src->str + f->start;
+	long len = f->len;
+	for (long i = 0; i < f->len; i++)
+	{
+		if (s[i] == '"') { len--; i++; }
+	}
+
+	lval* x = lval_str_buf(len);
+	for (long i = 0, j = 0; i < f->len; i++, j++)
+	{
+		x->str[j] = s[i];
+		if (s[i] == '"') { i++; }
+	}
+	return x;
+}
+
+static lval* csv_cell(lval* src, csv_field* f)
+{
+	long x;
+	if (csv_num(src->str, f, &x))
+	{
+		return lval_num(x);
+	}
+	return csv_str(src, f);
+}
+
+// a column that turns out not to be numbers, what it has so far becomes strings
+static void csv_col_strings(csv_col* c)
+{
+	char buf[24];
+	c->strs = malloc(sizeof(lval*) * c->cap);
+	for (long i = 0; i < c->count; i++)
+	{
+		int len = snprintf(buf, sizeof(buf), "%li", c->nums[i]);
+		c->strs[i] = lval_strn(buf, len);
+	}
+	free(c->nums);
+	c->nums = NULL;
+}
+
+static void csv_col_add(csv_col* c, lval* src, csv_field* f)
+{
+	if (c->count == c->cap)
+	{
+		c->cap *= 2;
+		if (c->nums) { c->nums = realloc(c->nums, sizeof(long) * c->cap); }
+		else { c->strs = realloc(c->strs, sizeof(lval*) * c->cap); }
+	}
+
+	if (c->nums)
+	{
+		if (csv_num(src->str, f, &c->nums[c->count]))
+		{
+			c->count++;
+			return;
+		}
+		csv_col_strings(c);
+	}
+	c->strs[c->count++] = csv_str(src, f);
+}
+
+// the column as a vector or a q-expression, c gives its cells up
+static lval* csv_column(csv_col* c)
+{
+	if (c->nums)
+	{
+		long* items = realloc(c->nums, sizeof(long) * (c->count ? c->count : 1));
+		c->nums = NULL;
+		return lval_vec(items, c->count);
+	}
+
+	lval* x = lval_qexpr();
+	x->cell = realloc(c->strs, sizeof(lval*) * (c->count ? c->count : 1));
+	x->count = c->count;
+	c->strs = NULL;
+	c->count = 0;
+	return x;
+}
+
+/*
+ * Each cell goes into its column as it is read: as a long
+ * while the column is all numbers, as a string otherwise.
+ * Nothing else is kept per cell, and no cell of a number
+ * column is ever an lval.
+ */
+static lval* csv_columns(lval* src)
+{
+	char* s = src->str;
+	long n = src->len;
+	long pos = 0;
+	long rows = 0;
+	csv_row row = { NULL, 0, 0 };
+	lval** names = NULL;
+	csv_col* cols = NULL;
+	int ncols = 0;
+	lval* err = NULL;
+
+	while (pos < n)
+	{
+		if (s[pos] == '\n' || s[pos] == '\r')
+		{
+			pos++;
+			continue;
+		}
+
+		rows++;
+		if (!csv_read_row(s, n, &pos, &row))
+		{
+			err = lval_err("Function 'read-csv' found an unclosed or misplaced quote in row %li.", rows);
+			break;
+		}
+
+		if (!names)
+		{
+			ncols = row.count;
+			names = malloc(sizeof(lval*) * ncols);
+			cols = calloc(ncols, sizeof(csv_col));
+			for (int c = 0; c < ncols; c++)
+			{
+				names[c] = csv_str(src, &row.fields[c]);
+				cols[c].nums = malloc(sizeof(long) * CSV_COL_INIT);
+				cols[c].cap = CSV_COL_INIT;
+			}
+			continue;
+		}
+
+		if (row.count != ncols)
+		{
+			err = lval_err("Function 'read-csv' found %i fields in row %li, "
+				"expected %i like the first.", row.count, rows, ncols);
+			break;
+		}
+		for (int c = 0; c < ncols; c++)
+		{
+			csv_col_add(&cols[c], src, &row.fields[c]);
+		}
+	}
+
+	lval* x = err ? err : lval_qexpr();
+	if (!err && ncols)
+	{
+		x->cell = malloc(sizeof(lval*) * ncols);
+		for (; x->count < ncols; x->count++)
+		{
+			lval* pair = lval_add(lval_qexpr(), lval_ref(names[x->count]));
+			x->cell[x->count] = lval_add(pair, csv_column(&cols[x->count]));
+		}
+	}
+
+	for (int c = 0; c < ncols; c++)
+	{
+		lval_del(names[c]);
+		free(cols[c].nums);
+		for (long i = 0; cols[c].strs && i < cols[c].count; i++)
+		{
+			lval_del(cols[c].strs[i]);
+		}
+		free(cols[c].strs);
+	}
+	free(names);
+	free(cols);
+	free(row.fields);
+	return x;
+}
+
+// calls (f acc row) on each row, a keeps f alive
+static lval* csv_fold(lenv* e, lval* a, lval* src)
+{
+	lval* f = a->cell[1];
+	lval* acc = lval_ref(a->cell[2]);
+	char* s = src->str;
+	long n = src->len;
+	long pos = 0;
+	long rows = 0;
+	csv_row row = { NULL, 0, 0 };
+
+	while (acc->type != LVAL_ERR && pos < n)
+	{
+		if (s[pos] == '\n' || s[pos] == '\r')
+		{
+			pos++;
+			continue;
+		}
+
+		rows++;
+		if (!csv_read_row(s, n, &pos, &row))
+		{
+			lval_del(acc);
+			acc = lval_err("Function 'read-csv' found an unclosed or misplaced quote in row %li.", rows);
+			break;
+		}
+
+		lval* r = lval_qexpr();
+		r->cell = malloc(sizeof(lval*) * row.count);
+		for (; r->count < row.count; r->count++)
+		{
+			r->cell[r->count] = csv_cell(src, &row.fields[r->count]);
+		}
+
+		lval* args = lval_add(lval_sexpr(), acc);
+		acc = lval_call(e, f, lval_add(args, r));
+	}
+
+	free(row.fields);
+	return acc;
+}
+
+/*
+ * (read-csv path) gives {{name column} ...}, named by the
+ * first row, e.g. for map-new. A column is a vector (see
+ * vec.h) when all of its cells are numbers, and a
+ * q-expression of strings otherwise. (read-csv path f z)
+ * calls (f acc row) on each row instead, the first one
+ * included, with row as {cell ...}. Only the page cache
+ * holds the file then, so it can be larger than memory.
+ */
+lval* builtin_read_csv(lenv* e, lval* a)
+{
+	LASSERT(a, a->count == 1 || a->count == 3,
+		"Function 'read-csv' passed incorrect number of arguments. "
+		"Got %i, Expected 1 or 3.", a->count);
+	LASSERT_TYPE("read-csv", a, 0, LVAL_STR);
+	if (a->count == 3)
+	{
+		LASSERT_TYPE("read-csv", a, 1, LVAL_FUN);
+	}
+
+	lval* src = lval_mmap_file(lval_cstr(a->cell[0]));
+	if (src->type == LVAL_ERR)
+	{
+		lval_del(a);
+		return src;
+	}
+
+	lval* x = a->count == 3 ? csv_fold(e, a, src) : csv_columns(src);
+	lval_del(src);
+	lval_del(a);
+	return x;
+}
@@ -0,0 +1,22 @@
+#ifndef CSV_H
+#define CSV_H
+
+typedef struct lval lval;
+typedef struct lenv lenv;
+
+/*
+ * CSV files, scanned in one pass over a mapping of the file
+ * (see lval_mmap_file). Fields are separated by commas and
+ * rows by \n or \r\n, blank lines are skipped. A field in
+ * double quotes can hold commas, newlines and "" for a
+ * quote. Fields that are integers as num->str writes them
+ * are read as numbers, the rest as strings, which point
+ * into the mapping unless they had quotes to undo.
+ */
+
+// first allocation for the cells of a column, doubled as it fills
+#define CSV_COL_INIT 64
+
+lval* builtin_read_csv(lenv*, lval*);
+
+#endif
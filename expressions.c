@@ -5,11 +5,15 @@
 #include "expressions.h"
 #include <string.h>
 #include "common.h"
+#include "stats.h"
 
 lval* lval_add(lval* v, lval* x) 
 {
 	v->count++;
+	v->hash = 0;
 	v->cell = realloc(v->cell, sizeof(lval*) * v->count);
+	STATS_INC(add_reallocs);
+	STATS_ADD(bytes, sizeof(lval*));
 	v->cell[v->count-1] = x;
 	return v;
 }
@@ -23,6 +27,7 @@ lval* lval_pop(lval* v, int i)
 		sizeof(lval*) * (v->count-i-1));
 
 	v->count--;
+	v->hash = 0;
 
 	v->cell = realloc(v->cell, sizeof(lval*) * v->count);
 	return x;
@@ -52,7 +57,7 @@ lval* builtin_head(__attribute__((unused)) lenv* e, lval* a)
 	LASSERT(a, a->cell[0]->count != 0, "Function 'head' passed an empty q-expression!");
 	
 
-	lval* v = lval_take(a, 0);
+	lval* v = lval_own(lval_take(a, 0));
 
 	while(v->count > 1)
 	{
@@ -73,7 +78,7 @@ lval* builtin_tail(__attribute__((unused)) lenv* e, lval* a)
 
 	LASSERT(a, a->cell[0]->count != 0, "Function 'tail' passed an empty q-expression!");
 
-	lval* v = lval_take(a, 0);
+	lval* v = lval_own(lval_take(a, 0));
 
 	lval_del(lval_pop(v, 0));
 	return v;
@@ -83,11 +88,15 @@ lval* builtin_tail(__attribute__((unused)) lenv* e, lval* a)
 lval* builtin_list(__attribute__((unused)) lenv* e, lval* a)
 {
 	a->type = LVAL_QEXPR;
+	a->hash = 0;
 	return a;
 }
 
 lval* lval_join(lval* x, lval*y)
 {
+	x = lval_own(x);
+	y = lval_own(y);
+
 	while(y->count)
 	{
 		x = lval_add(x, lval_pop(y, 0));
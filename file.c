@@ -0,0 +1,377 @@
+#include "lval.h"
+#include "lenv.h"
+#include "file.h"
+#include "rope.h"
+#include "builtins.h"
+#include "expressions.h"
+#include "common.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static lval* lval_file(int fd, int mode, char* path)
+{
+	lval* v = lval_new(LVAL_FILE);
+	v->file = calloc(1, sizeof(lfile));
+	v->file->fd = fd;
+	v->file->mode = mode;
+	v->file->path = malloc(strlen(path) + 1);
+	strcpy(v->file->path, path);
+	v->file->cap = FILE_BUF;
+	v->file->buf = malloc(FILE_BUF);
+	return v;
+}
+
+// 0 on failure, with errno set
+static int write_all(int fd, char* s, size_t len)
+{
+	while (len)
+	{
+		ssize_t n = write(fd, s, len);
+		if (n < 0 && errno == EINTR) { continue; }
+		if (n < 0) { return 0; }
+		s += n;
+		len -= n;
+	}
+	return 1;
+}
+
+static int file_flush(lfile* f)
+{
+	if (!write_all(f->fd, f->buf, f->end)) { return 0; }
+	f->end = 0;
+	return 1;
+}
+
+static int file_put(lfile* f, char* s, size_t n)
+{
+	if (n > f->cap - f->end && !file_flush(f)) { return 0; }
+
+	// too big to be worth copying into the buffer
+	if (n >= f->cap) { return write_all(f->fd, s, n); }
+
+	memcpy(f->buf + f->end, s, n);
+	f->end += n;
+	return 1;
+}
+
+// reads the next block after what is unread, 0 at the end of the file, -1 on failure
+static ssize_t file_fill(lfile* f)
+{
+	if (f->start > 0)
+	{
+		memmove(f->buf, f->buf + f->start, f->end - f->start);
+		f->end -= f->start;
+		f->start = 0;
+	}
+	// a line longer than the buffer, the only way it grows
+	if (f->end == f->cap)
+	{
+		f->cap *= 2;
+		f->buf = realloc(f->buf, f->cap);
+	}
+
+	ssize_t n;
+	do { n = read(f->fd, f->buf + f->end, f->cap - f->end); } while (n < 0 && errno == EINTR);
+	if (n > 0) { f->end += n; }
+	if (n == 0) { f->eof = 1; }
+	return n;
+}
+
+/*
+ * Finds the next line and consumes it, without its newline.
+ * Its bytes stay in the buffer until the next read. 1 if
+ * there is a line, 0 at the end of the file, -1 on failure.
+ */
+static int file_line(lfile* f, char** s, size_t* len)
+{
+	// bytes already known to hold no newline
+	size_t scanned = 0;
+	while (1)
+	{
+		char* from = f->buf + f->start;
+		// memchr compares a vector of bytes at a time
+		char* nl = memchr(from + scanned, '\n', f->end - f->start - scanned);
+		if (nl)
+		{
+			*s = from;
+			*len = nl - from;
+			f->start += *len + 1;
+			return 1;
+		}
+		scanned = f->end - f->start;
+
+		if (f->eof)
+		{
+			if (scanned == 0) { return 0; }
+			*s = from;
+			*len = scanned;
+			f->start = f->end;
+			return 1;
+		}
+		if (file_fill(f) < 0) { return -1; }
+	}
+}
+
+static int file_close(lfile* f)
+{
+	if (f->fd < 0) { return 1; }
+
+	int ok = f->mode != FILE_WRITE || file_flush(f);
+	// the first failure is the one to report
+	int err = errno;
+	if (close(f->fd) != 0 && ok) { ok = 0; }
+	else { errno = err; }
+	f->fd = -1;
+	return ok;
+}
+
+void lfile_del(lfile* f)
+{
+	file_close(f);
+	free(f->path);
+	free(f->buf);
+	free(f);
+}
+
+#define LASSERT_FILE(func, args, index, want) \
+	LASSERT_TYPE(func, args, index, LVAL_FILE); \
+	LASSERT(args, args->cell[index]->file->fd >= 0, \
+		"Function '%s' passed a closed file.", func); \
+	LASSERT(args, args->cell[index]->file->mode == want, \
+		"Function '%s' passed a file open for %s.", func, \
+		want == FILE_READ ? "writing" : "reading")
+
+/*
+ * Builtins
+ */
+
+// (file-open path mode) with mode "r" to read, "w" to write over or "a" to append
+lval* builtin_file_open(__attribute__((unused)) lenv* e, lval* a)
+{
+	LASSERT_NUM("file-open", a, 2);
+	LASSERT_TYPE("file-open", a, 0, LVAL_STR);
+	LASSERT_TYPE("file-open", a, 1, LVAL_STR);
+
+	char* path = lval_cstr(a->cell[0]);
+	char* mode = lval_cstr(a->cell[1]);
+	int flags;
+	if (strcmp(mode, "r") == 0) { flags = O_RDONLY; }
+	else if (strcmp(mode, "w") == 0) { flags = O_WRONLY | O_CREAT | O_TRUNC; }
+	else if (strcmp(mode, "a") == 0) { flags = O_WRONLY | O_CREAT | O_APPEND; }
+	else
+	{
+		lval* err = lval_err("Function 'file-open' passed unknown mode \"%s\", "
+			"expected \"r\", \"w\" or \"a\".", mode);
+		lval_del(a);
+		return err;
+	}
+
+	int fd = open(path, flags, 0644);
+	LASSERT(a, fd >= 0, "Could not open %s: %s", path, strerror(errno));
+
+	lval* x = lval_file(fd, flags == O_RDONLY ? FILE_READ : FILE_WRITE, path);
+	lval_del(a);
+	return x;
+}
+
+lval* builtin_file_close(__attribute__((unused)) lenv* e, lval* a)
+{
+	LASSERT_NUM("file-close", a, 1);
+	LASSERT_TYPE("file-close", a, 0, LVAL_FILE);
+
+	lfile* f = a->cell[0]->file;
+	LASSERT(a, file_close(f), "Could not close %s: %s", f->path, strerror(errno));
+
+	lval_del(a);
+	return lval_sexpr();
+}
+
+// (read-line file) the next line without its newline, {} at the end of the file
+lval* builtin_read_line(__attribute__((unused)) lenv* e, lval* a)
+{
+	LASSERT_NUM("read-line", a, 1);
+	LASSERT_FILE("read-line", a, 0, FILE_READ);
+
+	lfile* f = a->cell[0]->file;
+	char* s;
+	size_t len;
+	int r = file_line(f, &s, &len);
+	LASSERT(a, r >= 0, "Could not read %s: %s", f->path, strerror(errno));
+
+	lval* x = r ? lval_strn(s, len) : lval_qexpr();
+	lval_del(a);
+	return x;
+}
+
+// (read-all file) the rest of the file
+lval* builtin_read_all(__attribute__((unused)) lenv* e, lval* a)
+{
+	LASSERT_NUM("read-all", a, 1);
+	LASSERT_FILE("read-all", a, 0, FILE_READ);
+
+	lfile* f = a->cell[0]->file;
+	while (!f->eof)
+	{
+		LASSERT(a, file_fill(f) >= 0, "Could not read %s: %s", f->path, strerror(errno));
+	}
+
+	lval* x = lval_strn(f->buf + f->start, f->end - f->start);
+	f->start = f->end;
+	lval_del(a);
+	return x;
+}
+
+// (write file s ...) the strings one after another, as they are
+lval* builtin_write(__attribute__((unused)) lenv* e, lval* a)
+{
+	LASSERT(a, a->count >= 1, "Function 'write' passed no arguments!");
+	LASSERT_FILE("write", a, 0, FILE_WRITE);
+	for (int i = 1; i < a->count; i++)
+	{
+		LASSERT_TYPE("write", a, i, LVAL_STR);
+	}
+
+	lfile* f = a->cell[0]->file;
+	for (int i = 1; i < a->count; i++)
+	{
+		rope_iter it;
+		rope_iter_init(&it, a->cell[i]);
+		char* s;
+		long n;
+		while (rope_iter_next(&it, &s, &n))
+		{
+			LASSERT(a, file_put(f, s, n), "Could not write %s: %s", f->path, strerror(errno));
+		}
+	}
+
+	lval_del(a);
+	return lval_sexpr();
+}
+
+lval* builtin_flush(__attribute__((unused)) lenv* e, lval* a)
+{
+	LASSERT_NUM("flush", a, 1);
+	LASSERT_FILE("flush", a, 0, FILE_WRITE);
+
+	lfile* f = a->cell[0]->file;
+	LASSERT(a, file_flush(f), "Could not write %s: %s", f->path, strerror(errno));
+
+	lval_del(a);
+	return lval_sexpr();
+}
+
+// lines of a string are views into it, nothing is copied but short lines
+static lval* fold_lines_str(lenv* e, lval* a)
+{
+	lval* f = a->cell[0];
+	lval* acc = lval_ref(a->cell[1]);
+	lval* s = a->cell[2];
+	if (s->depth) { rope_flatten(s); }
+
+	long start = 0;
+	while (acc->type != LVAL_ERR && start < s->len)
+	{
+		char* nl = memchr(s->str + start, '\n', s->len - start);
+		long end = nl ? nl - s->str : s->len;
+
+		lval* args = lval_add(lval_sexpr(), acc);
+		args = lval_add(args, lval_str_view(s, start, end - start));
+		acc = lval_call(e, f, args);
+		start = end + 1;
+	}
+
+	lval_del(a);
+	return acc;
+}
+
+/*
+ * (fold-lines f z file) calls (f acc line) on every line
+ * left in file, starting with acc z. file can also be a
+ * string, such as one from mmap-file.
+ */
+lval* builtin_fold_lines(lenv* e, lval* a)
+{
+	LASSERT_NUM("fold-lines", a, 3);
+	LASSERT_TYPE("fold-lines", a, 0, LVAL_FUN);
+	if (a->cell[2]->type == LVAL_STR) { return fold_lines_str(e, a); }
+	LASSERT_FILE("fold-lines", a, 2, FILE_READ);
+
+	// a keeps f and the file alive while the lines are read
+	lval* f = a->cell[0];
+	lval* acc = lval_ref(a->cell[1]);
+	lfile* file = a->cell[2]->file;
+
+	char* s;
+	size_t len;
+	int r = 1;
+	while (acc->type != LVAL_ERR && file->fd >= 0 && (r = file_line(file, &s, &len)) > 0)
+	{
+		lval* args = lval_add(lval_sexpr(), acc);
+		args = lval_add(args, lval_strn(s, len));
+		acc = lval_call(e, f, args);
+	}
+
+	if (r < 0)
+	{
+		lval_del(acc);
+		acc = lval_err("Could not read %s: %s", file->path, strerror(errno));
+	}
+	lval_del(a);
+	return acc;
+}
+
+// the contents of path as a view of its mapping (see mmap-file), or an error
+lval* lval_mmap_file(char* path)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) { return lval_err("Could not open %s: %s", path, strerror(errno)); }
+
+	struct stat st;
+	if (fstat(fd, &st) != 0)
+	{
+		lval* err = lval_err("Could not open %s: %s", path, strerror(errno));
+		close(fd);
+		return err;
+	}
+
+	// mmap refuses empty files
+	if (st.st_size == 0)
+	{
+		close(fd);
+		return lval_str("");
+	}
+
+	char* p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	int map_errno = errno;
+	close(fd);
+	if (p == MAP_FAILED) { return lval_err("Could not map %s: %s", path, strerror(map_errno)); }
+
+	lval* m = lval_str_mapped(p, st.st_size);
+	lval* x = lval_str_view(m, 0, m->len);
+	lval_del(m);
+	return x;
+}
+
+/*
+ * (mmap-file path) the contents of the file as a string
+ * that points into a read only mapping of it. substr,
+ * str-split and fold-lines on it give views into the
+ * mapping, which stays until the last of them goes. The
+ * pages are the page cache's, nothing is read up front.
+ * The file should not change while it is mapped.
+ */
+lval* builtin_mmap_file(__attribute__((unused)) lenv* e, lval* a)
+{
+	LASSERT_NUM("mmap-file", a, 1);
+	LASSERT_TYPE("mmap-file", a, 0, LVAL_STR);
+
+	lval* x = lval_mmap_file(lval_cstr(a->cell[0]));
+	lval_del(a);
+	return x;
+}
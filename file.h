@@ -0,0 +1,48 @@
+#ifndef FILE_H
+#define FILE_H
+
+#include <stddef.h>
+
+typedef struct lval lval;
+typedef struct lenv lenv;
+
+/*
+ * Files opened from Phi, read and written through a buffer
+ * of their own in FILE_BUF blocks. Reads only keep the
+ * current block (and the line being read, if it is longer)
+ * in memory, however big the file is. A file is a handle:
+ * copies share it rather than the contents, and it is
+ * closed when the last one goes, if file-close has not
+ * closed it already.
+ */
+#define FILE_BUF (64 * 1024)
+
+enum { FILE_READ, FILE_WRITE };
+
+typedef struct lfile
+{
+	// -1 once closed
+	int fd;
+	int mode;
+	char* path;
+	char* buf;
+	// reading: buf[start, end) is read and not consumed yet, writing: buf[0, end) is unwritten
+	size_t start;
+	size_t end;
+	size_t cap;
+	int eof;
+} lfile;
+
+void lfile_del(lfile*);
+lval* lval_mmap_file(char*);
+
+lval* builtin_file_open(lenv*, lval*);
+lval* builtin_file_close(lenv*, lval*);
+lval* builtin_read_line(lenv*, lval*);
+lval* builtin_read_all(lenv*, lval*);
+lval* builtin_write(lenv*, lval*);
+lval* builtin_flush(lenv*, lval*);
+lval* builtin_fold_lines(lenv*, lval*);
+lval* builtin_mmap_file(lenv*, lval*);
+
+#endif
@@ -0,0 +1,486 @@
+#include "lval.h"
+#include "lenv.h"
+#include "hamt.h"
+#include "map.h"
+#include "builtins.h"
+#include "expressions.h"
+#include "common.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+lval* lval_hamt(void)
+{
+	lval* v = lval_new(LVAL_HAMT);
+	v->hamt = calloc(1, sizeof(lhamt));
+	return v;
+}
+
+/*
+ * Nodes
+ */
+
+static hnode* node_new(void)
+{
+	hnode* n = calloc(1, sizeof(hnode));
+	n->refs = 1;
+	return n;
+}
+
+static void node_release(hnode* n)
+{
+	if (--n->refs > 0)
+	{
+		return;
+	}
+
+	for (int i = 0; i < n->count; i++)
+	{
+		if (n->slots[i].node)
+		{
+			node_release(n->slots[i].node);
+		} else {
+			lval_del(n->slots[i].key);
+			lval_del(n->slots[i].val);
+		}
+	}
+	free(n->slots);
+	free(n);
+}
+
+// a node the caller can change, n is given up
+static hnode* node_own(hnode* n)
+{
+	if (n->refs == 1)
+	{
+		return n;
+	}
+
+	hnode* x = node_new();
+	x->bitmap = n->bitmap;
+	x->count = n->count;
+	x->slots = malloc(sizeof(hslot) * n->count);
+	memcpy(x->slots, n->slots, sizeof(hslot) * n->count);
+
+	for (int i = 0; i < n->count; i++)
+	{
+		if (x->slots[i].node)
+		{
+			x->slots[i].node->refs++;
+		} else {
+			lval_ref(x->slots[i].key);
+			lval_ref(x->slots[i].val);
+		}
+	}
+
+	n->refs--;
+	return x;
+}
+
+static int node_index(hnode* n, unsigned int bit)
+{
+	return __builtin_popcount(n->bitmap & (bit - 1));
+}
+
+static unsigned int node_bit(unsigned long long hash, int shift)
+{
+	return 1u << ((hash >> shift) & ((1 << HAMT_BITS) - 1));
+}
+
+static hslot* slot_insert(hnode* n, int idx)
+{
+	n->slots = realloc(n->slots, sizeof(hslot) * (n->count + 1));
+	memmove(&n->slots[idx + 1], &n->slots[idx], sizeof(hslot) * (n->count - idx));
+	n->count++;
+	return &n->slots[idx];
+}
+
+static void slot_remove(hnode* n, int idx)
+{
+	memmove(&n->slots[idx], &n->slots[idx + 1], sizeof(hslot) * (n->count - idx - 1));
+	n->count--;
+}
+
+// takes key and val over, added is set when the key is new
+static hnode* node_put(hnode* n, int shift, unsigned long long hash, lval* key, lval* val, int* added)
+{
+	n = node_own(n);
+
+	// past the last level all keys of a node have the same hash
+	if (shift >= 64)
+	{
+		for (int i = 0; i < n->count; i++)
+		{
+			if (lval_eq(n->slots[i].key, key))
+			{
+				lval_del(n->slots[i].val);
+				n->slots[i].val = val;
+				lval_del(key);
+				return n;
+			}
+		}
+		*slot_insert(n, n->count) = (hslot) { hash, key, val, NULL };
+		*added = 1;
+		return n;
+	}
+
+	unsigned int bit = node_bit(hash, shift);
+	int idx = node_index(n, bit);
+
+	if (!(n->bitmap & bit))
+	{
+		n->bitmap |= bit;
+		*slot_insert(n, idx) = (hslot) { hash, key, val, NULL };
+		*added = 1;
+		return n;
+	}
+
+	hslot* s = &n->slots[idx];
+	if (s->node)
+	{
+		s->node = node_put(s->node, shift + HAMT_BITS, hash, key, val, added);
+		return n;
+	}
+
+	if (s->hash == hash && lval_eq(s->key, key))
+	{
+		lval_del(s->val);
+		s->val = val;
+		lval_del(key);
+		return n;
+	}
+
+	// two keys on one branch, both move a level down
+	int moved;
+	hnode* sub = node_put(node_new(), shift + HAMT_BITS, s->hash, s->key, s->val, &moved);
+	s->node = node_put(sub, shift + HAMT_BITS, hash, key, val, added);
+	s->key = s->val = NULL;
+	return n;
+}
+
+// key has to be in n, NULL is returned when n ends up empty
+static hnode* node_del(hnode* n, int shift, unsigned long long hash, lval* key)
+{
+	n = node_own(n);
+
+	int idx = 0;
+	unsigned int bit = 0;
+
+	if (shift >= 64)
+	{
+		while (!lval_eq(n->slots[idx].key, key)) { idx++; }
+	} else {
+		bit = node_bit(hash, shift);
+		idx = node_index(n, bit);
+
+		hslot* s = &n->slots[idx];
+		if (s->node)
+		{
+			hnode* c = node_del(s->node, shift + HAMT_BITS, hash, key);
+
+			// a branch down to a single key is folded back into this node
+			if (c->count == 1 && !c->slots[0].node)
+			{
+				*s = c->slots[0];
+				lval_ref(s->key);
+				lval_ref(s->val);
+				node_release(c);
+			} else {
+				s->node = c;
+			}
+			return n;
+		}
+	}
+
+	lval_del(n->slots[idx].key);
+	lval_del(n->slots[idx].val);
+	slot_remove(n, idx);
+	n->bitmap &= ~bit;
+
+	if (n->count == 0)
+	{
+		node_release(n);
+		return NULL;
+	}
+	return n;
+}
+
+/*
+ * Maps
+ */
+
+// a second map with the same entries, the nodes are shared
+lhamt* lhamt_share(lhamt* h)
+{
+	lhamt* x = calloc(1, sizeof(lhamt));
+	x->count = h->count;
+	x->root = h->root;
+	if (x->root) { x->root->refs++; }
+	return x;
+}
+
+void lhamt_del(lhamt* h)
+{
+	if (h->root) { node_release(h->root); }
+	free(h);
+}
+
+// the value stored under key, still owned by the map, NULL if there is none
+lval* lhamt_get(lhamt* h, lval* key)
+{
+	unsigned long long hash = lval_hash(key);
+	hnode* n = h->root;
+
+	for (int shift = 0; n; shift += HAMT_BITS)
+	{
+		if (shift >= 64)
+		{
+			for (int i = 0; i < n->count; i++)
+			{
+				if (lval_eq(n->slots[i].key, key)) { return n->slots[i].val; }
+			}
+			return NULL;
+		}
+
+		unsigned int bit = node_bit(hash, shift);
+		if (!(n->bitmap & bit)) { return NULL; }
+
+		hslot* s = &n->slots[node_index(n, bit)];
+		if (!s->node)
+		{
+			return s->hash == hash && lval_eq(s->key, key) ? s->val : NULL;
+		}
+		n = s->node;
+	}
+	return NULL;
+}
+
+// takes key and val over
+void lhamt_put(lhamt* h, lval* key, lval* val)
+{
+	int added = 0;
+	if (!h->root) { h->root = node_new(); }
+	h->root = node_put(h->root, 0, lval_hash(key), key, val, &added);
+	h->count += added;
+}
+
+int lhamt_remove(lhamt* h, lval* key)
+{
+	if (!lhamt_get(h, key)) { return 0; }
+
+	h->root = node_del(h->root, 0, lval_hash(key), key);
+	h->count--;
+	return 1;
+}
+
+/*
+ * Iteration, depth first with an explicit stack
+ */
+
+void hamt_iter_init(hamt_iter* it, lhamt* h)
+{
+	it->depth = 0;
+	if (h->root)
+	{
+		it->nodes[0] = h->root;
+		it->next[0] = 0;
+		it->depth = 1;
+	}
+}
+
+// borrowed key and val of the next entry, 0 after the last one
+int hamt_iter_next(hamt_iter* it, lval** key, lval** val)
+{
+	while (it->depth)
+	{
+		hnode* n = it->nodes[it->depth - 1];
+		int i = it->next[it->depth - 1]++;
+
+		if (i == n->count)
+		{
+			it->depth--;
+			continue;
+		}
+
+		hslot* s = &n->slots[i];
+		if (s->node)
+		{
+			it->nodes[it->depth] = s->node;
+			it->next[it->depth] = 0;
+			it->depth++;
+			continue;
+		}
+
+		*key = s->key;
+		*val = s->val;
+		return 1;
+	}
+	return 0;
+}
+
+/*
+ * Builtins
+ */
+
+// (hamt-new {{key value} ...}), built in place before anyone else can see it
+lval* builtin_hamt_new(__attribute__((unused)) lenv* e, lval* a)
+{
+	LASSERT_NUM("hamt-new", a, 1);
+	LASSERT_TYPE("hamt-new", a, 0, LVAL_QEXPR);
+
+	lval* pairs = a->cell[0];
+	for (int i = 0; i < pairs->count; i++)
+	{
+		lval* p = pairs->cell[i];
+		LASSERT(a, p->type == LVAL_QEXPR && p->count == 2,
+			"Function 'hamt-new' expected {key value} pairs, element %i is not one.", i);
+		LASSERT(a, lmap_key_ok(p->cell[0]),
+			"Function 'hamt-new' passed a %s key at %i, keys are numbers, "
+			"strings, symbols, booleans or q-expressions of those.",
+			ltype_name(p->cell[0]->type), i);
+	}
+
+	lval* x = lval_hamt();
+	for (int i = 0; i < pairs->count; i++)
+	{
+		lval* p = pairs->cell[i];
+		lhamt_put(x->hamt, lval_ref(p->cell[0]), lval_ref(p->cell[1]));
+	}
+
+	lval_del(a);
+	return x;
+}
+
+// (hamt-get map key) or (hamt-get map key default)
+lval* builtin_hamt_get(__attribute__((unused)) lenv* e, lval* a)
+{
+	LASSERT(a, a->count == 2 || a->count == 3,
+		"Function 'hamt-get' passed incorrect number of arguments. "
+		"Got %i, Expected 2 or 3.", a->count);
+	LASSERT_TYPE("hamt-get", a, 0, LVAL_HAMT);
+
+	lval* v = lhamt_get(a->cell[0]->hamt, a->cell[1]);
+	if (!v)
+	{
+		LASSERT(a, a->count == 3, "Function 'hamt-get' passed a key that is not in the map.");
+		return lval_take(a, 2);
+	}
+
+	v = lval_ref(v);
+	lval_del(a);
+	return v;
+}
+
+// (hamt-put map key value)
+lval* builtin_hamt_put(__attribute__((unused)) lenv* e, lval* a)
+{
+	LASSERT_NUM("hamt-put", a, 3);
+	LASSERT_TYPE("hamt-put", a, 0, LVAL_HAMT);
+	LASSERT(a, lmap_key_ok(a->cell[1]),
+		"Function 'hamt-put' passed a %s key, keys are numbers, "
+		"strings, symbols, booleans or q-expressions of those.",
+		ltype_name(a->cell[1]->type));
+
+	lval* h = lval_own(lval_pop(a, 0));
+	lval* key = lval_pop(a, 0);
+	lval* val = lval_pop(a, 0);
+
+	lhamt_put(h->hamt, key, val);
+	h->hash = 0;
+
+	lval_del(a);
+	return h;
+}
+
+// (hamt-del map key), a missing key leaves the map as it is
+lval* builtin_hamt_del(__attribute__((unused)) lenv* e, lval* a)
+{
+	LASSERT_NUM("hamt-del", a, 2);
+	LASSERT_TYPE("hamt-del", a, 0, LVAL_HAMT);
+
+	lval* h = lval_pop(a, 0);
+	if (lhamt_get(h->hamt, a->cell[0]))
+	{
+		h = lval_own(h);
+		lhamt_remove(h->hamt, a->cell[0]);
+		h->hash = 0;
+	}
+
+	lval_del(a);
+	return h;
+}
+
+static lval* hamt_list(lval* a, char* func, int pairs)
+{
+	LASSERT_NUM(func, a, 1);
+	LASSERT_TYPE(func, a, 0, LVAL_HAMT);
+
+	lhamt* h = a->cell[0]->hamt;
+	lval* x = lval_qexpr();
+	x->cell = malloc(sizeof(lval*) * h->count);
+
+	hamt_iter it;
+	hamt_iter_init(&it, h);
+	lval* key;
+	lval* val;
+	while (hamt_iter_next(&it, &key, &val))
+	{
+		lval* item = lval_ref(key);
+		if (pairs)
+		{
+			item = lval_add(lval_add(lval_qexpr(), item), lval_ref(val));
+		}
+		x->cell[x->count++] = item;
+	}
+
+	lval_del(a);
+	return x;
+}
+
+lval* builtin_hamt_keys(__attribute__((unused)) lenv* e, lval* a)
+{
+	return hamt_list(a, "hamt-keys", 0);
+}
+
+// {{key value} ...}
+lval* builtin_hamt_items(__attribute__((unused)) lenv* e, lval* a)
+{
+	return hamt_list(a, "hamt-items", 1);
+}
+
+lval* builtin_hamt_count(__attribute__((unused)) lenv* e, lval* a)
+{
+	LASSERT_NUM("hamt-count", a, 1);
+	LASSERT_TYPE("hamt-count", a, 0, LVAL_HAMT);
+
+	lval* x = lval_num(a->cell[0]->hamt->count);
+	lval_del(a);
+	return x;
+}
+
+// (hamt-fold f z map) calls (f acc key value) on every entry, starting with acc z
+lval* builtin_hamt_fold(lenv* e, lval* a)
+{
+	LASSERT_NUM("hamt-fold", a, 3);
+	LASSERT_TYPE("hamt-fold", a, 0, LVAL_FUN);
+	LASSERT_TYPE("hamt-fold", a, 2, LVAL_HAMT);
+
+	// a keeps f and the map alive while the entries are visited
+	lval* f = a->cell[0];
+	lval* acc = lval_ref(a->cell[1]);
+
+	hamt_iter it;
+	hamt_iter_init(&it, a->cell[2]->hamt);
+	lval* key;
+	lval* val;
+	while (acc->type != LVAL_ERR && hamt_iter_next(&it, &key, &val))
+	{
+		lval* args = lval_add(lval_sexpr(), acc);
+		args = lval_add(args, lval_ref(key));
+		args = lval_add(args, lval_ref(val));
+		acc = lval_call(e, f, args);
+	}
+
+	lval_del(a);
+	return acc;
+}
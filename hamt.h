@@ -0,0 +1,73 @@
+#ifndef HAMT_H
+#define HAMT_H
+
+typedef struct lval lval;
+typedef struct lenv lenv;
+
+/*
+ * Persistent maps, as hash array mapped tries. Each level
+ * takes 5 bits of lval_hash, a bitmap says which of its 32
+ * branches are there and only those are stored. Below the
+ * last level, keys with the same hash share a list.
+ *
+ * Nodes are counted like lvals. An update copies the nodes
+ * on the path to the key that have more than one owner and
+ * changes the rest in place, so versions share everything
+ * else, and building a map nobody else holds yet (as
+ * hamt-new does from its pairs) never copies at all.
+ */
+#define HAMT_BITS 5
+#define HAMT_MAX_DEPTH 14
+
+typedef struct hnode hnode;
+
+typedef struct hslot
+{
+	unsigned long long hash;
+	lval* key;
+	lval* val;
+	// set for a branch, key and val are unused then
+	hnode* node;
+} hslot;
+
+struct hnode
+{
+	int refs;
+	unsigned int bitmap;
+	int count;
+	hslot* slots;
+};
+
+typedef struct lhamt
+{
+	int count;
+	hnode* root;
+} lhamt;
+
+typedef struct hamt_iter
+{
+	int depth;
+	hnode* nodes[HAMT_MAX_DEPTH];
+	int next[HAMT_MAX_DEPTH];
+} hamt_iter;
+
+lval* lval_hamt(void);
+lhamt* lhamt_share(lhamt*);
+void lhamt_del(lhamt*);
+lval* lhamt_get(lhamt*, lval*);
+void lhamt_put(lhamt*, lval*, lval*);
+int lhamt_remove(lhamt*, lval*);
+
+void hamt_iter_init(hamt_iter*, lhamt*);
+int hamt_iter_next(hamt_iter*, lval**, lval**);
+
+lval* builtin_hamt_new(lenv*, lval*);
+lval* builtin_hamt_get(lenv*, lval*);
+lval* builtin_hamt_put(lenv*, lval*);
+lval* builtin_hamt_del(lenv*, lval*);
+lval* builtin_hamt_keys(lenv*, lval*);
+lval* builtin_hamt_items(lenv*, lval*);
+lval* builtin_hamt_count(lenv*, lval*);
+lval* builtin_hamt_fold(lenv*, lval*);
+
+#endif
@@ -1,6 +1,7 @@
 #include "lval.h"
 #include "mpc.h"
 #include "lenv.h"
+#include "stats.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -13,6 +14,7 @@ lenv* lenv_new(void)
 	env->count = 0;
 	env->syms = NULL;
 	env->vals = NULL;
+	env->phi = NULL;
 	return env;
 }
 
@@ -31,6 +33,7 @@ void lenv_del(lenv* e)
 lenv* lenv_copy(lenv* e)
 {
 	lenv* n = malloc(sizeof(lenv));
+	STATS_INC(env_copies);
 	n->par = e->par;
 	n->count = e->count;
 	n->syms = malloc(sizeof(char*) * n->count);
@@ -53,20 +56,24 @@ void lenv_def(lenv* e, lval* k, lval* v)
 
 lval* lenv_get(lenv* e, lval* k)
 {
-	for (int i = 0; i < e->count; i++)
+	STATS_INC(env_lookups);
+
+	for (long depth = 1; e; e = e->par, depth++)
 	{
-		if (strcmp(e->syms[i], k->sym) == 0)
+		STATS_INC(env_depth);
+		if (depth > stats.env_depth_max) { stats.env_depth_max = depth; }
+
+		for (int i = 0; i < e->count; i++)
 		{
-			return lval_copy(e->vals[i]);
+			if (strcmp(e->syms[i], k->sym) == 0)
+			{
+				// shared, whoever changes it gets a copy from lval_own
+				return lval_ref(e->vals[i]);
+			}
 		}
 	}
-	
-	if (e->par)
-	{
-		return lenv_get(e->par, k);
-	} else {
-		return lval_err("Unbound symbol '%s'", k->sym);
-	}
+
+	return lval_err("Unbound symbol '%s'", k->sym);
 }
 
 void lenv_put(lenv* e, lval* k, lval* v)
@@ -76,7 +83,7 @@ void lenv_put(lenv* e, lval* k, lval* v)
 		if (strcmp(e->syms[i], k->sym) == 0)
 		{
 			lval_del(e->vals[i]);
-			e->vals[i] = lval_copy(v);
+			e->vals[i] = lval_ref(v);
 			return;
 		}
 	}
@@ -85,8 +92,30 @@ void lenv_put(lenv* e, lval* k, lval* v)
 	e->vals = realloc(e->vals, sizeof(lval*) * e->count);
 	e->syms = realloc(e->syms, sizeof(char*) * e->count);
 
-	e->vals[e->count-1] = lval_copy(v);
+	e->vals[e->count-1] = lval_ref(v);
 	e->syms[e->count-1] = malloc(strlen(k->sym)+1);
 	strcpy(e->syms[e->count-1], k->sym);
 }
 
+
+// like lenv_put, but takes v over instead of sharing it
+void lenv_bind(lenv* e, char* sym, lval* v)
+{
+	for (int i = 0; i < e->count; i++)
+	{
+		if (strcmp(e->syms[i], sym) == 0)
+		{
+			lval_del(e->vals[i]);
+			e->vals[i] = v;
+			return;
+		}
+	}
+
+	e->count++;
+	e->vals = realloc(e->vals, sizeof(lval*) * e->count);
+	e->syms = realloc(e->syms, sizeof(char*) * e->count);
+
+	e->vals[e->count-1] = v;
+	e->syms[e->count-1] = malloc(strlen(sym)+1);
+	strcpy(e->syms[e->count-1], sym);
+}
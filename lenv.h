@@ -21,5 +21,6 @@ lenv* lenv_copy(lenv*);
 lval* lenv_get(lenv*, lval*);
 void lenv_def(lenv*, lval*, lval*);
 void lenv_put(lenv*, lval*, lval*);
+void lenv_bind(lenv*, char*, lval*);
 
 #endif
@@ -3,33 +3,187 @@
 #include <stdlib.h>
 #include <stdarg.h>
 #include <string.h>
-#include "mpc.h"
+#include <sys/mman.h>
+#include "stats.h"
+#include "memo.h"
+#include "map.h"
+#include "hamt.h"
+#include "omap.h"
+#include "pqueue.h"
+#include "rope.h"
+#include "file.h"
+#include "vec.h"
+
+// lists at least this long are compared by hash first
+#define LVAL_EQ_HASH_MIN 8
+
+// every lval is allocated here, so it can be counted
+lval* lval_new(int type)
+{
+	lval* v = malloc(sizeof(lval));
+	v->type = type;
+	v->refs = 1;
+	v->hash = 0;
+	stats_alloc(type, sizeof(lval));
+	return v;
+}
+
+// share v, the new owner has to lval_del it as well
+lval* lval_ref(lval* v)
+{
+	v->refs++;
+	return v;
+}
+
+static lval* lval_clone(lval*);
+
+// a value the caller can change, v is given up
+lval* lval_own(lval* v)
+{
+	// a file is a handle, whoever has it can read and write through it
+	if (v->refs == 1 || v->type == LVAL_FUN || v->type == LVAL_FILE)
+	{
+		return v;
+	}
+
+	lval* x;
+	if (v->type == LVAL_SEXPR || v->type == LVAL_QEXPR)
+	{
+		// only the container is new, the children stay shared
+		x = lval_new(v->type);
+		x->hash = v->hash;
+		x->count = v->count;
+		x->cell = malloc(sizeof(lval*) * v->count);
+		for (int i = 0; i < v->count; i++)
+		{
+			x->cell[i] = lval_ref(v->cell[i]);
+		}
+	} else if (v->type == LVAL_MAP) {
+		// entries are shared, as with lists
+		x = lval_new(LVAL_MAP);
+		x->hash = v->hash;
+		x->map = lmap_copy(v->map, lval_ref);
+	} else if (v->type == LVAL_HAMT) {
+		x = lval_new(LVAL_HAMT);
+		x->hash = v->hash;
+		x->hamt = lhamt_share(v->hamt);
+	} else if (v->type == LVAL_OMAP) {
+		x = lval_new(LVAL_OMAP);
+		x->hash = v->hash;
+		x->omap = lomap_share(v->omap);
+	} else if (v->type == LVAL_PQUEUE) {
+		x = lval_new(LVAL_PQUEUE);
+		x->hash = v->hash;
+		x->pqueue = lpqueue_copy(v->pqueue, lval_ref);
+	} else {
+		x = lval_clone(v);
+	}
 
-lenv* lenv_new(void);
-void lenv_del(lenv*);
-lenv* lenv_copy(lenv*);
+	lval_del(v);
+	return x;
+}
 
 lval* lval_num(long x)
 {
-	lval* v = malloc(sizeof(lval));
-	v->type = LVAL_NUM;
+	lval* v = lval_new(LVAL_NUM);
 	v->num = x;
 	return v;
 }
 
+// room for len bytes and a NUL in v, inline when they fit
+static void lval_str_alloc(lval* v, long len)
+{
+	v->len = len;
+	v->base = NULL;
+	v->depth = 0;
+	v->mapped = 0;
+	if (len <= LVAL_SSO_LEN)
+	{
+		v->str = v->sso;
+	} else {
+		v->str = malloc(len + 1);
+		STATS_ADD(bytes, len + 1);
+	}
+	v->str[len] = '\0';
+}
+
+// a string of len bytes for the caller to fill in
+lval* lval_str_buf(long len)
+{
+	lval* v = lval_new(LVAL_STR);
+	lval_str_alloc(v, len);
+	return v;
+}
+
+lval* lval_strn(char* s, long len)
+{
+	lval* v = lval_str_buf(len);
+	memcpy(v->str, s, len);
+	return v;
+}
+
 lval* lval_str(char* s)
 {
-	lval* v = malloc(sizeof(lval));
-	v->type = LVAL_STR;
-	v->str = malloc(strlen(s) + 1);
-	strcpy(v->str, s);
+	return lval_strn(s, strlen(s));
+}
+
+/*
+ * The len bytes of flat string s from start on, sharing them
+ * instead of copying unless they fit inline. A view keeps
+ * the whole string it points into alive.
+ */
+lval* lval_str_view(lval* s, long start, long len)
+{
+	if (len <= LVAL_SSO_LEN)
+	{
+		return lval_strn(s->str + start, len);
+	}
+
+	lval* v = lval_new(LVAL_STR);
+	v->len = len;
+	v->str = s->str + start;
+	v->base = lval_ref(s->base ? s->base : s);
+	v->depth = 0;
+	v->mapped = 0;
+	return v;
+}
+
+// owner of the len bytes mapped at p, which it unmaps when it goes
+lval* lval_str_mapped(char* p, long len)
+{
+	lval* v = lval_new(LVAL_STR);
+	v->len = len;
+	v->str = p;
+	v->base = NULL;
+	v->depth = 0;
+	v->mapped = 1;
 	return v;
 }
 
+// str of a string with a NUL after it, ropes and views are copied out first
+char* lval_cstr(lval* v)
+{
+	if (v->depth)
+	{
+		rope_flatten(v);
+	} else if (v->base && (v->base->mapped || v->str[v->len] != '\0'))
+	{
+		lval* base = v->base;
+		char* s = malloc(v->len + 1);
+		STATS_ADD(bytes, v->len + 1);
+		memcpy(s, v->str, v->len);
+		s[v->len] = '\0';
+		v->str = s;
+		v->base = NULL;
+		lval_del(base);
+	}
+	return v->str;
+}
+
 lval* lval_err(char* fmt, ...)
 {
-	lval* v = malloc(sizeof(lval));
-	v->type = LVAL_ERR;
+	lval* v = lval_new(LVAL_ERR);
+	STATS_INC(err_formats);
 
 
 	va_list va;
@@ -40,6 +194,7 @@ lval* lval_err(char* fmt, ...)
 	vsnprintf(v->err, 511, fmt, va);
 
 	v->err = realloc(v->err, strlen(v->err)+1);
+	STATS_ADD(bytes, strlen(v->err) + 1);
 
 	va_end(va);
 
@@ -48,17 +203,16 @@ lval* lval_err(char* fmt, ...)
 
 lval* lval_sym(char* s)
 {
-	lval* v = malloc(sizeof(lval));
-	v->type = LVAL_SYM;
+	lval* v = lval_new(LVAL_SYM);
 	v->sym = malloc(strlen(s)+1);
+	STATS_ADD(bytes, strlen(s) + 1);
 	strcpy(v->sym, s);
 	return v;
 }
 
 lval* lval_sexpr(void)
 {
-	lval* v = malloc(sizeof(lval));
-	v->type = LVAL_SEXPR;
+	lval* v = lval_new(LVAL_SEXPR);
 	v->count = 0;
 	v->cell = NULL;
 	return v;
@@ -66,8 +220,7 @@ lval* lval_sexpr(void)
 
 lval* lval_qexpr(void)
 {
-	lval* v = malloc(sizeof(lval));
-	v->type = LVAL_QEXPR;
+	lval* v = lval_new(LVAL_QEXPR);
 	v->count = 0;
 	v->cell = NULL;
 	return v;
@@ -75,8 +228,7 @@ lval* lval_qexpr(void)
 
 lval* lval_bool(int state)
 {
-	lval* v = malloc(sizeof(lval));
-	v->type = LVAL_BOOL;
+	lval* v = lval_new(LVAL_BOOL);
 	if (state == 0){
 		v->bool_state = FALSE;
 	} else {
@@ -87,20 +239,22 @@ lval* lval_bool(int state)
 
 lval* lval_fun(lbuiltin func)
 {
-	lval* v = malloc(sizeof(lval));
-	v->type = LVAL_FUN;
+	lval* v = lval_new(LVAL_FUN);
 	v->builtin = func;
+	v->name = NULL;
+	v->fn = NULL;
+	v->memo = NULL;
 	return v;
 }
 
 lval* lval_lambda(lval* formals, lval* body)
 {
-	lval* v = malloc(sizeof(lval));
-	v->type = LVAL_FUN;
+	lval* v = lval_new(LVAL_FUN);
 
 	v->builtin = NULL;
-
-	v->env = lenv_new();
+	v->name = NULL;
+	v->fn = NULL;
+	v->memo = NULL;
 
 	v->formals = formals;
 	v->body = body;
@@ -108,15 +262,42 @@ lval* lval_lambda(lval* formals, lval* body)
 	return v;
 }
 
+// fn applied to no arguments yet, they are added to cell
+lval* lval_partial(lval* fn)
+{
+	lval* v = lval_new(LVAL_FUN);
+
+	v->builtin = NULL;
+	v->name = fn->name;
+	v->fn = fn;
+	v->memo = NULL;
+	v->formals = NULL;
+	v->body = NULL;
+	v->count = 0;
+	v->cell = NULL;
+
+	return v;
+}
+
 void lval_del(lval* v)
 {
+	if (--v->refs > 0)
+	{
+		return;
+	}
+
 	switch(v->type)
 	{
 	
 		case LVAL_NUM: break;
 		case LVAL_BOOL: break;
 
-		case LVAL_STR: free(v->str); break;
+		case LVAL_STR:
+			if (v->depth) { lval_del(v->left); lval_del(v->right); }
+			else if (v->base) { lval_del(v->base); }
+			else if (v->mapped) { munmap(v->str, v->len); }
+			else if (v->str != v->sso) { free(v->str); }
+			break;
 
 		case LVAL_ERR: free(v->err); break;
 		case LVAL_SYM: free(v->sym); break;
@@ -131,22 +312,51 @@ void lval_del(lval* v)
 			free(v->cell);
 			break;
 		case LVAL_FUN:
-			if (!v->builtin)
+			if (v->memo)
 			{
-				lenv_del(v->env);
+				lmemo_del(v->memo);
+			} else if (v->fn) {
+				lval_del(v->fn);
+				for (int i = 0; i < v->count; i++)
+				{
+					lval_del(v->cell[i]);
+				}
+				free(v->cell);
+			} else if (!v->builtin) {
 				lval_del(v->formals);
 				lval_del(v->body);
 			}
 			break;
 
+		case LVAL_MAP: lmap_del(v->map); break;
+		case LVAL_HAMT: lhamt_del(v->hamt); break;
+		case LVAL_OMAP: lomap_del(v->omap); break;
+		case LVAL_PQUEUE: lpqueue_del(v->pqueue); break;
+		case LVAL_FILE: lfile_del(v->file); break;
+		case LVAL_VEC: lvec_del(v->vec); break;
+
 	}
+	STATS_ADD(live, -1);
 	free(v);
 }
 
 lval* lval_copy(lval* v)
 {
-	lval* x = malloc(sizeof(lval));
-	x->type = v->type;
+	// functions, vectors and shared values never change, so copies can share them
+	if (v->type == LVAL_FUN || v->type == LVAL_FILE || v->type == LVAL_VEC || v->refs > 1)
+	{
+		return lval_ref(v);
+	}
+
+	return lval_clone(v);
+}
+
+// a new value equal to v, children are copied with lval_copy
+static lval* lval_clone(lval* v)
+{
+	lval* x = lval_new(v->type);
+	x->hash = v->hash;
+	STATS_INC(copies);
 
 	switch(v->type)
 	{
@@ -154,54 +364,92 @@ lval* lval_copy(lval* v)
 			x->num = v->num; break;
 		case LVAL_BOOL:
 			x->bool_state = v->bool_state; break;
+		// ropes and views share what they point to, it never changes
 		case LVAL_STR:
-			x->str = malloc(strlen(v->str) + 1);
-			strcpy(x->str, v->str);
-			break;
-		case LVAL_FUN:
-			if (v->builtin)
+			if (v->depth || v->base)
 			{
-				x->builtin= v->builtin; 
+				x->len = v->len;
+				x->str = v->str;
+				x->depth = v->depth;
+				x->mapped = 0;
+				x->base = v->base ? lval_ref(v->base) : NULL;
+				if (v->depth)
+				{
+					x->left = lval_ref(v->left);
+					x->right = lval_ref(v->right);
+				}
 			} else {
-				x->builtin = NULL;
-				x->env = lenv_copy(v->env);
-				x->formals = lval_copy(v->formals);
-				x->body = lval_copy(v->body);
+				lval_str_alloc(x, v->len);
+				memcpy(x->str, v->str, v->len);
 			}
 			break;
-
 		case LVAL_ERR:
 			x->err = malloc(strlen(v->err) + 1);
+			STATS_ADD(bytes, strlen(v->err) + 1);
 			strcpy(x->err, v->err); break;
 
 		case LVAL_SYM:
 			x->sym = malloc(strlen(v->sym) + 1);
+			STATS_ADD(bytes, strlen(v->sym) + 1);
 			strcpy(x->sym, v->sym); break;
 
 		case LVAL_SEXPR:
 		case LVAL_QEXPR:
 			x->count = v->count;
-			x->cell = malloc(v->count * sizeof(lval));
+			x->cell = malloc(v->count * sizeof(lval*));
+			STATS_ADD(bytes, v->count * sizeof(lval*));
 			for (int i = 0; i < v->count; i++)
 			{
 				x->cell[i] = lval_copy(v->cell[i]);
 			}
 		break;
+
+		case LVAL_MAP:
+			x->map = lmap_copy(v->map, lval_copy);
+		break;
+
+		// nodes are copied when they are changed, not before
+		case LVAL_HAMT:
+			x->hamt = lhamt_share(v->hamt);
+		break;
+		case LVAL_OMAP:
+			x->omap = lomap_share(v->omap);
+		break;
+
+		case LVAL_PQUEUE:
+			x->pqueue = lpqueue_copy(v->pqueue, lval_copy);
+		break;
+
+		case LVAL_VEC:
+			x->vec = lvec_copy(v->vec);
+		break;
 	}
 	return x;
 }
 
 int lval_eq(lval* x, lval* y)
 {
+	// interned and shared values are compared by identity
+	if (x == y)
+	{
+		return 1;
+	}
+
 	if (x->type != y->type)
 	{
 		return 0;
 	}
 
+	// hashes already computed settle most unequal pairs
+	if (x->hash && y->hash && x->hash != y->hash)
+	{
+		return 0;
+	}
+
 	switch (x->type)
 	{
 		case LVAL_NUM: return (x->num == y->num);
-		case LVAL_STR: return (strcmp(x->str, y->str) == 0);
+		case LVAL_STR: return x->len == y->len && rope_cmp(x, y) == 0;
 		case LVAL_ERR: return (strcmp(x->err, y->err) == 0);
 		case LVAL_SYM: return (strcmp(x->sym, y->sym) == 0);
 
@@ -209,15 +457,113 @@ int lval_eq(lval* x, lval* y)
 			if (x->builtin || y->builtin)
 			{
 				return x->builtin == y->builtin;
-			} else {
-				return lval_eq(x->formals, y->formals) && lval_eq(x->body, y->body);
 			}
+			if (x->memo || y->memo)
+			{
+				return x->memo == y->memo;
+			}
+			if (x->fn || y->fn)
+			{
+				if (!x->fn || !y->fn || x->count != y->count || !lval_eq(x->fn, y->fn))
+				{
+					return 0;
+				}
+				for (int i = 0; i < x->count; i++)
+				{
+					if (!lval_eq(x->cell[i], y->cell[i]))
+					{
+						return 0;
+					}
+				}
+				return 1;
+			}
+			return lval_eq(x->formals, y->formals) && lval_eq(x->body, y->body);
+
+		case LVAL_MAP:
+			if (x->map->count != y->map->count)
+			{
+				return 0;
+			}
+			for (int i = 0; i < x->map->count; i++)
+			{
+				lval* v = lmap_get(y->map, x->map->entries[i].key);
+				if (!v || !lval_eq(x->map->entries[i].val, v))
+				{
+					return 0;
+				}
+			}
+			return 1;
+
+		case LVAL_HAMT:
+		{
+			if (x->hamt->count != y->hamt->count)
+			{
+				return 0;
+			}
+			if (x->hamt->root == y->hamt->root)
+			{
+				return 1;
+			}
+
+			hamt_iter it;
+			hamt_iter_init(&it, x->hamt);
+			lval* key;
+			lval* val;
+			while (hamt_iter_next(&it, &key, &val))
+			{
+				lval* v = lhamt_get(y->hamt, key);
+				if (!v || !lval_eq(val, v))
+				{
+					return 0;
+				}
+			}
+			return 1;
+		}
+
+		// both are in key order, so the entries pair up
+		case LVAL_OMAP:
+		{
+			if (x->omap->count != y->omap->count)
+			{
+				return 0;
+			}
+			if (x->omap->root == y->omap->root)
+			{
+				return 1;
+			}
+
+			omap_iter ix, iy;
+			omap_iter_init(&ix, x->omap);
+			omap_iter_init(&iy, y->omap);
+			lval *xk, *xv, *yk, *yv;
+			while (omap_iter_next(&ix, &xk, &xv) && omap_iter_next(&iy, &yk, &yv))
+			{
+				if (!lval_eq(xk, yk) || !lval_eq(xv, yv))
+				{
+					return 0;
+				}
+			}
+			return 1;
+		}
+
+		case LVAL_PQUEUE:
+			return lpqueue_eq(x->pqueue, y->pqueue);
+
+		case LVAL_VEC:
+			return x->vec->count == y->vec->count
+				&& memcmp(x->vec->items, y->vec->items, sizeof(long) * x->vec->count) == 0;
+
 		case LVAL_QEXPR:
 		case LVAL_SEXPR:
 			if (x->count != y->count)
 			{
 				return 0;
 			}
+			// long lists are worth hashing, the hash is kept on both
+			if (x->count >= LVAL_EQ_HASH_MIN && lval_hash(x) != lval_hash(y))
+			{
+				return 0;
+			}
 			for (int i = 0; i < y->count; i++)
 			{
 				if (!lval_eq(x->cell[i], y->cell[i]))
@@ -231,70 +577,228 @@ int lval_eq(lval* x, lval* y)
 	return 0;
 }
 
-void lval_expr_print(lval* v, char open, char close)
+/*
+ * Structural hash, values that are lval_eq hash the same.
+ * The finaliser is the one from splitmix64. It is cached
+ * in v->hash, so whatever changes a value in place has to
+ * reset that to 0.
+ */
+static unsigned long long hash_mix(unsigned long long h)
 {
-	putchar(open);
-	for (int i = 0; i < v->count; i++)
+	h ^= h >> 30; h *= 0xbf58476d1ce4e5b9ULL;
+	h ^= h >> 27; h *= 0x94d049bb133111ebULL;
+	h ^= h >> 31;
+	return h;
+}
+
+#define HASH_BYTES_INIT 0xcbf29ce484222325ULL
+
+// FNV-1a, h carries on from the bytes before s
+static unsigned long long hash_bytes(unsigned long long h, char* s, long len)
+{
+	for (long i = 0; i < len; i++) { h = (h ^ (unsigned char) s[i]) * 0x100000001b3ULL; }
+	return h;
+}
+
+static unsigned long long hash_str(char* s)
+{
+	return hash_bytes(HASH_BYTES_INIT, s, strlen(s));
+}
+
+static unsigned long long lval_hash_compute(lval* v)
+{
+	unsigned long long h = hash_mix(v->type + 1);
+
+	switch (v->type)
 	{
-		lval_print(v->cell[i]);
+		case LVAL_NUM: return hash_mix(h ^ (unsigned long long) v->num);
+		case LVAL_BOOL: return hash_mix(h ^ (unsigned long long) v->bool_state);
+		case LVAL_STR:
+		{
+			unsigned long long b = HASH_BYTES_INIT;
+			rope_iter it;
+			rope_iter_init(&it, v);
+			char* s;
+			long n;
+			while (rope_iter_next(&it, &s, &n)) { b = hash_bytes(b, s, n); }
+			return hash_mix(h ^ b);
+		}
+		case LVAL_ERR: return hash_mix(h ^ hash_str(v->err));
+		case LVAL_SYM: return hash_mix(h ^ hash_str(v->sym));
+		// equal only to itself
+		case LVAL_FILE: return hash_mix(h ^ (unsigned long long)(size_t) v->file);
+		case LVAL_VEC:
+			for (long i = 0; i < v->vec->count; i++)
+			{
+				h = hash_mix(h ^ (unsigned long long) v->vec->items[i]);
+			}
+			return h;
 
-		if (i != (v->count-1)) 
+		case LVAL_FUN:
+			if (v->builtin) { return hash_mix(h ^ (unsigned long long)(size_t) v->builtin); }
+			if (v->memo) { return hash_mix(h ^ (unsigned long long)(size_t) v->memo); }
+			if (v->fn) { h = hash_mix(h ^ lval_hash(v->fn)); break; }
+			return hash_mix(h ^ lval_hash(v->formals) ^ hash_mix(lval_hash(v->body)));
+
+		case LVAL_MAP:
+		{
+			// summed, so the order of the entries does not matter
+			unsigned long long sum = 0;
+			for (int i = 0; i < v->map->count; i++)
+			{
+				lmap_entry* e = &v->map->entries[i];
+				sum += hash_mix(lval_hash(e->key) ^ hash_mix(lval_hash(e->val)));
+			}
+			return hash_mix(h ^ sum);
+		}
+
+		case LVAL_HAMT:
+		{
+			unsigned long long sum = 0;
+			hamt_iter it;
+			hamt_iter_init(&it, v->hamt);
+			lval* key;
+			lval* val;
+			while (hamt_iter_next(&it, &key, &val))
+			{
+				sum += hash_mix(lval_hash(key) ^ hash_mix(lval_hash(val)));
+			}
+			return hash_mix(h ^ sum);
+		}
+
+		case LVAL_OMAP:
+		{
+			omap_iter it;
+			omap_iter_init(&it, v->omap);
+			lval* key;
+			lval* val;
+			while (omap_iter_next(&it, &key, &val))
+			{
+				h = hash_mix(h ^ lval_hash(key));
+				h = hash_mix(h ^ lval_hash(val));
+			}
+			return h;
+		}
+
+		case LVAL_PQUEUE:
 		{
-			putchar(' ');
+			// summed, as heaps of the same entries can be laid out differently
+			unsigned long long sum = 0;
+			for (int i = 0; i < v->pqueue->count; i++)
+			{
+				pq_entry* e = &v->pqueue->entries[i];
+				sum += hash_mix((unsigned long long) e->prio ^ hash_mix(lval_hash(e->val)));
+			}
+			return hash_mix(h ^ sum);
 		}
 	}
-	putchar(close);
-} 
 
-void lval_print_str(lval* v) {
-  /* Make a Copy of the string */
-  char* escaped = malloc(strlen(v->str)+1);
-  strcpy(escaped, v->str);
-  /* Pass it through the escape function */
-  escaped = mpcf_escape(escaped);
-  /* Print it between " characters */
-  printf("\"%s\"", escaped);
-  /* free the copied string */
-  free(escaped);
+	for (int i = 0; i < v->count; i++)
+	{
+		h = hash_mix(h ^ lval_hash(v->cell[i]));
+	}
+	return h;
 }
 
-void lval_print(lval* v)
+unsigned long long lval_hash(lval* v)
 {
-	switch (v->type)
+	if (!v->hash)
 	{
-		case LVAL_NUM: printf("%li", v->num); break;
+		// 0 marks a hash not computed yet
+		unsigned long long h = lval_hash_compute(v);
+		v->hash = h ? h : 1;
+	}
+	return v->hash;
+}
 
-		case LVAL_BOOL: 
-			if (v->bool_state == TRUE)
-			{
-				printf("true");
-			} else {
-				printf("false");
-			}
-		break;
+/*
+ * Hash consing. With --hash-cons every literal that is read
+ * is looked up in a table of the values read so far, and an
+ * equal one is shared instead of kept as a second tree. The
+ * table holds a reference to each entry, so interned values
+ * always have more than one owner and are never changed in
+ * place. Entries live until lval_intern_free.
+ */
+int lval_hash_cons = 0;
+
+static lval** interned = NULL;
+static size_t interned_count = 0;
+static size_t interned_cap = 0;
+
+static void intern_insert(lval* v)
+{
+	size_t i = v->hash & (interned_cap - 1);
+	while (interned[i]) { i = (i + 1) & (interned_cap - 1); }
+	interned[i] = v;
+}
+
+static void intern_grow(void)
+{
+	lval** old = interned;
+	size_t old_cap = interned_cap;
+
+	interned_cap = interned_cap ? interned_cap * 2 : 256;
+	interned = calloc(interned_cap, sizeof(lval*));
+
+	for (size_t i = 0; i < old_cap; i++)
+	{
+		if (old[i]) { intern_insert(old[i]); }
+	}
+	free(old);
+}
 
-		// if an error, print message relevant to the error
-		case LVAL_ERR: printf("Error: %s", v->err); break;
-		case LVAL_QEXPR: lval_expr_print(v, '{', '}');  break;
-		case LVAL_SEXPR: lval_expr_print(v, '(', ')');  break;
-		case LVAL_SYM: printf("%s", v->sym); break;
-		case LVAL_FUN: 
-			if (v->builtin)
+// v is given up, an equal value already read is returned for it
+lval* lval_intern(lval* v)
+{
+	// functions and errors are never literals, shared values are left as they are
+	if (v->type == LVAL_FUN || v->type == LVAL_ERR || v->refs > 1)
+	{
+		return v;
+	}
+
+	if (v->type == LVAL_SEXPR || v->type == LVAL_QEXPR)
+	{
+		for (int i = 0; i < v->count; i++)
+		{
+			v->cell[i] = lval_intern(v->cell[i]);
+		}
+		v->hash = 0;
+	}
+
+	unsigned long long h = lval_hash(v);
+
+	if (interned_cap)
+	{
+		for (size_t i = h & (interned_cap - 1); interned[i]; i = (i + 1) & (interned_cap - 1))
+		{
+			// children are interned already, so this compares pointers
+			if (interned[i]->hash == h && lval_eq(interned[i], v))
 			{
-				printf("<builtin>");
-			} else {
-				printf("(\\ "); lval_print(v->formals);
-				putchar(' '); lval_print(v->body); putchar(')');
+				STATS_INC(hash_cons_hits);
+				lval_del(v);
+				return lval_ref(interned[i]);
 			}
-		break;
-		case LVAL_STR: lval_print_str(v); break;
+		}
+	}
+
+	if (2 * (interned_count + 1) > interned_cap)
+	{
+		intern_grow();
 	}
+	intern_insert(lval_ref(v));
+	interned_count++;
+	return v;
 }
 
-void lval_println(lval* v)
+void lval_intern_free(void)
 {
-	lval_print(v);
-	putchar('\n');
+	for (size_t i = 0; i < interned_cap; i++)
+	{
+		if (interned[i]) { lval_del(interned[i]); }
+	}
+	free(interned);
+	interned = NULL;
+	interned_count = interned_cap = 0;
 }
 
 char* ltype_name(int t)
@@ -309,6 +813,12 @@ char* ltype_name(int t)
 		case LVAL_SEXPR: return "S-expression"; break;
 		case LVAL_QEXPR: return "Q-expression"; break;
 		case LVAL_BOOL: return "Boolean"; break;
+		case LVAL_MAP: return "Map"; break;
+		case LVAL_HAMT: return "HAMT"; break;
+		case LVAL_OMAP: return "Ordered Map"; break;
+		case LVAL_PQUEUE: return "Priority Queue"; break;
+		case LVAL_FILE: return "File"; break;
+		case LVAL_VEC: return "Vector"; break;
 		default: return "Unknown";
 	}
 }
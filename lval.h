@@ -12,13 +12,28 @@ enum
 	LVAL_SEXPR, 
 	LVAL_QEXPR, 
 	LVAL_FUN,
-	LVAL_BOOL
+	LVAL_BOOL,
+	LVAL_MAP,
+	LVAL_HAMT,
+	LVAL_OMAP,
+	LVAL_PQUEUE,
+	LVAL_FILE,
+	LVAL_VEC,
+
+	// number of types, keep last (and below STATS_TYPES)
+	LVAL_TYPE_COUNT
 };
 
 typedef struct lenv lenv;
 
 typedef lval*(*lbuiltin)(lenv*, lval*);
 
+// strings up to this long are kept inside the lval
+#define LVAL_SSO_LEN 15
+
+// set by --hash-cons, read code is interned (see lval_intern)
+extern int lval_hash_cons;
+
 #define TRUE 1
 #define FALSE 0
 
@@ -26,17 +41,16 @@ struct lval
 {
 	int type;
 
-	long num;
-	char* err;
-	char* sym;
-	char* str;
-
-	lbuiltin builtin;
-	lenv* env;
-	lval* formals;
-	lval* body;
-	
-	// number of child lvals
+	/*
+	 * Number of owners. A value with more than one owner
+	 * is immutable, lval_own gives back one that is not.
+	 */
+	int refs;
+
+	// structural hash, 0 until lval_hash computes it
+	unsigned long long hash;
+
+	// number of child lvals, of lists and partial applications
 	int count;
 	/* 
 	 * Pointer to a list of child lvals
@@ -49,13 +63,79 @@ struct lval
 	 */
 	struct lval** cell;
 
-	char bool_state;
+	// what a value holds depends on its type, so the types share the space
+	union
+	{
+		long num;
+		char bool_state;
+		char* err;
+		char* sym;
+
+		// LVAL_STR
+		struct
+		{
+			char* str;
+			// length of the string, str ends in a NUL unless it is a view
+			long len;
+			// string a view (see lval_str_view) points into, NULL otherwise
+			lval* base;
+			// height of a rope, 0 for strings with their bytes in one piece
+			int depth;
+			// str is a read only file mapping (see mmap-file), only views point at it
+			int mapped;
+			union
+			{
+				// bytes of a short string, str points here
+				char sso[LVAL_SSO_LEN + 1];
+				// halves of a rope (see rope.h), when depth is not 0 and str is NULL
+				struct
+				{
+					lval* left;
+					lval* right;
+				};
+			};
+		};
+
+		// LVAL_FUN
+		struct
+		{
+			lbuiltin builtin;
+			// name a function was defined under, interned (see profile.h)
+			char* name;
+			lval* formals;
+			lval* body;
+			// function a partial application binds the args in cell for
+			lval* fn;
+			// result cache of a memoized function (see memo.h)
+			struct lmemo* memo;
+		};
 
+		// entries of a map (see map.h)
+		struct lmap* map;
+		// persistent map (see hamt.h)
+		struct lhamt* hamt;
+		// ordered map (see omap.h)
+		struct lomap* omap;
+		// priority queue (see pqueue.h)
+		struct lpqueue* pqueue;
+		// open file (see file.h)
+		struct lfile* file;
+		// vector of numbers (see vec.h)
+		struct lvec* vec;
+	};
 };
 
+lval* lval_new(int);
 void lval_del(lval*);
+lval* lval_ref(lval*);
+lval* lval_own(lval*);
 lval* lval_num(long);
 lval* lval_str(char*);
+lval* lval_strn(char*, long);
+lval* lval_str_buf(long);
+lval* lval_str_view(lval*, long, long);
+lval* lval_str_mapped(char*, long);
+char* lval_cstr(lval*);
 lval* lval_err(char*, ...);
 lval* lval_sym(char*);
 lval* lval_sexpr(void);
@@ -63,9 +143,13 @@ lval* lval_qexpr(void);
 lval* lval_bool(int);
 lval* lval_fun(lbuiltin);
 lval* lval_lambda(lval*, lval*);
+lval* lval_partial(lval*);
 lval* lval_copy(lval*);
 int lval_eq(lval*, lval*);
-void lval_expr_print(lval*, char, char);
+unsigned long long lval_hash(lval*);
+lval* lval_intern(lval*);
+void lval_intern_free(void);
+// see print.h
 void lval_print(lval*);
 void lval_println(lval*);
 char* ltype_name(int);
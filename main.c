@@ -9,9 +9,14 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <string.h>
 
 #include "common.h"
 #include "builtins.h"
+#include "serialize.h"
+#include "prelude.h"
+#include "profile.h"
+#include "stats.h"
 
 int main(__attribute__((unused)) int argc, __attribute__((unused)) char** argv) 
 {
@@ -29,10 +34,72 @@ int main(__attribute__((unused)) int argc, __attribute__((unused)) char** argv)
 	// add the Phi parser to the env
 	env->phi = Phi;
 
-	if (argc >= 2)
+	// the prelude is compiled in, unless asked not to
+	int no_prelude = 0;
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--no-prelude") == 0) { no_prelude = 1; }
+	}
+
+	if (!no_prelude && !lenv_image_decode(prelude_image, prelude_image_len, env))
+	{
+		fputs("Could not install the prelude\n", stderr);
+	}
+
+	// --image FILE starts from a dumped env, --dump-image FILE
+	// writes the env out once the files have been loaded
+	char* dump_image = NULL;
+	char* profile_out = NULL;
+	int print_stats = 0;
+	int nfiles = 0;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--no-prelude") == 0)
+		{
+			argv[i] = NULL;
+		} else if (strcmp(argv[i], "--stats") == 0) {
+			print_stats = 1;
+			argv[i] = NULL;
+		} else if (strcmp(argv[i], "--hash-cons") == 0) {
+			lval_hash_cons = 1;
+			argv[i] = NULL;
+		} else if (strcmp(argv[i], "--image") == 0 && i + 1 < argc)
+		{
+			if (!lenv_image_load(argv[++i], env))
+			{
+				fprintf(stderr, "Could not load image %s\n", argv[i]);
+				env->phi = NULL;
+				lenv_del(env);
+				free_parsers(_parser_elements);
+				return 1;
+			}
+			argv[i - 1] = argv[i] = NULL;
+		} else if (strcmp(argv[i], "--profile") == 0 && i + 1 < argc) {
+			// folded stacks go to FILE, the self/total table to stderr
+			profile_out = argv[++i];
+			argv[i - 1] = argv[i] = NULL;
+			if (!profile_start())
+			{
+				fputs("Could not start the profiler\n", stderr);
+			}
+		} else if (strcmp(argv[i], "--no-cache") == 0) {
+			lval_cache_enabled = 0;
+			argv[i] = NULL;
+		} else if (strcmp(argv[i], "--dump-image") == 0 && i + 1 < argc) {
+			dump_image = argv[++i];
+			argv[i - 1] = argv[i] = NULL;
+		} else {
+			nfiles++;
+		}
+	}
+
+	if (nfiles || dump_image)
 	{
 		for (int i = 1; i < argc; i++)
 		{
+			if (!argv[i]) { continue; }
+
 			lval* args = lval_add(lval_sexpr(), lval_str(argv[i]));
 
 			lval* x = builtin_load(env, args);
@@ -43,6 +110,11 @@ int main(__attribute__((unused)) int argc, __attribute__((unused)) char** argv)
 			}
 			lval_del(x);
 		}
+
+		if (dump_image && !lenv_image_dump(dump_image, env))
+		{
+			fprintf(stderr, "Could not write image %s\n", dump_image);
+		}
 	} else {
 
 		/* Debug info */
@@ -62,6 +134,13 @@ int main(__attribute__((unused)) int argc, __attribute__((unused)) char** argv)
 			{
 				// Parse successful
 				lval* x = lval_read(r.output);
+				if (lval_hash_cons)
+				{
+					for (int i = 0; i < x->count; i++)
+					{
+						x->cell[i] = lval_intern(x->cell[i]);
+					}
+				}
 				lval* result = lval_eval(env, x);
 				lval_println(result);
 				lval_del(result);
@@ -78,10 +157,30 @@ int main(__attribute__((unused)) int argc, __attribute__((unused)) char** argv)
 	
 		}
 	}
+	if (profile_out)
+	{
+		profile_stop();
+
+		FILE* folded = fopen(profile_out, "w");
+		if (!folded)
+		{
+			fprintf(stderr, "Could not write profile %s\n", profile_out);
+		}
+		profile_report(folded, stderr);
+		if (folded) { fclose(folded); }
+	}
+
+	if (print_stats)
+	{
+		stats_print(stderr);
+	}
+
 	// Phi = NULL;
 	env->phi = NULL;
 	lenv_del(env);
+	lval_intern_free();
 	free_parsers(_parser_elements);
+	profile_free();
 
 	return 0;
 
@@ -0,0 +1,302 @@
+#include "lval.h"
+#include "lenv.h"
+#include "map.h"
+#include "expressions.h"
+#include "common.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+lval* lval_map(void)
+{
+	lval* v = lval_new(LVAL_MAP);
+	v->map = calloc(1, sizeof(lmap));
+	return v;
+}
+
+static void table_insert(lmap* m, int idx)
+{
+	int mask = m->table_size - 1;
+	int i = m->entries[idx].hash & mask;
+	while (m->table[i] != -1) { i = (i + 1) & mask; }
+	m->table[i] = idx;
+}
+
+static void map_resize(lmap* m, int cap)
+{
+	m->entries = realloc(m->entries, sizeof(lmap_entry) * cap);
+	m->cap = cap;
+
+	// at most half full
+	int table_size = 1;
+	while (table_size < cap * 2) { table_size *= 2; }
+
+	free(m->table);
+	m->table = malloc(sizeof(int) * table_size);
+	m->table_size = table_size;
+	for (int i = 0; i < table_size; i++) { m->table[i] = -1; }
+	for (int i = 0; i < m->count; i++) { table_insert(m, i); }
+}
+
+// copy gives each key and value to the new map, lval_ref or lval_copy
+lmap* lmap_copy(lmap* m, lval*(*copy)(lval*))
+{
+	lmap* x = calloc(1, sizeof(lmap));
+	if (m->count == 0) { return x; }
+
+	x->count = m->count;
+	x->entries = malloc(sizeof(lmap_entry) * m->count);
+	for (int i = 0; i < m->count; i++)
+	{
+		x->entries[i].hash = m->entries[i].hash;
+		x->entries[i].key = copy(m->entries[i].key);
+		x->entries[i].val = copy(m->entries[i].val);
+	}
+	map_resize(x, m->count);
+	return x;
+}
+
+void lmap_del(lmap* m)
+{
+	for (int i = 0; i < m->count; i++)
+	{
+		lval_del(m->entries[i].key);
+		lval_del(m->entries[i].val);
+	}
+	free(m->entries);
+	free(m->table);
+	free(m);
+}
+
+int lmap_key_ok(lval* k)
+{
+	switch (k->type)
+	{
+		case LVAL_NUM:
+		case LVAL_STR:
+		case LVAL_SYM:
+		case LVAL_BOOL:
+			return 1;
+		case LVAL_QEXPR:
+			for (int i = 0; i < k->count; i++)
+			{
+				if (!lmap_key_ok(k->cell[i])) { return 0; }
+			}
+			return 1;
+	}
+	return 0;
+}
+
+// slot in m->table of key, or of the empty slot that ends its run
+static int map_slot(lmap* m, unsigned long long hash, lval* key)
+{
+	int mask = m->table_size - 1;
+	int i = hash & mask;
+	for (; m->table[i] != -1; i = (i + 1) & mask)
+	{
+		lmap_entry* e = &m->entries[m->table[i]];
+		if (e->hash == hash && lval_eq(e->key, key)) { break; }
+	}
+	return i;
+}
+
+// the value stored under key, still owned by the map, NULL if there is none
+lval* lmap_get(lmap* m, lval* key)
+{
+	if (!m->count) { return NULL; }
+
+	int idx = m->table[map_slot(m, lval_hash(key), key)];
+	return idx == -1 ? NULL : m->entries[idx].val;
+}
+
+// takes key and val over
+void lmap_put(lmap* m, lval* key, lval* val)
+{
+	unsigned long long hash = lval_hash(key);
+
+	if (m->count)
+	{
+		int idx = m->table[map_slot(m, hash, key)];
+		if (idx != -1)
+		{
+			lval_del(m->entries[idx].val);
+			m->entries[idx].val = val;
+			lval_del(key);
+			return;
+		}
+	}
+
+	if (m->count == m->cap)
+	{
+		map_resize(m, m->cap ? m->cap * 2 : 8);
+	}
+
+	lmap_entry* e = &m->entries[m->count];
+	e->hash = hash;
+	e->key = key;
+	e->val = val;
+	table_insert(m, m->count++);
+}
+
+/*
+ * Removal shifts the rest of the probe run back, so no
+ * tombstones are needed, then moves the last entry into
+ * the freed index.
+ */
+int lmap_remove(lmap* m, lval* key)
+{
+	if (!m->count) { return 0; }
+
+	int mask = m->table_size - 1;
+	int slot = map_slot(m, lval_hash(key), key);
+	int idx = m->table[slot];
+	if (idx == -1) { return 0; }
+
+	m->table[slot] = -1;
+	for (int j = (slot + 1) & mask; m->table[j] != -1; j = (j + 1) & mask)
+	{
+		int home = m->entries[m->table[j]].hash & mask;
+
+		// entries whose home lies cyclically in (slot, j] stay put
+		int stays = slot <= j ? (home > slot && home <= j) : (home > slot || home <= j);
+		if (!stays)
+		{
+			m->table[slot] = m->table[j];
+			m->table[j] = -1;
+			slot = j;
+		}
+	}
+
+	lval_del(m->entries[idx].key);
+	lval_del(m->entries[idx].val);
+
+	int last = --m->count;
+	if (idx != last)
+	{
+		// point the slot of the last entry at its new index
+		int i = m->entries[last].hash & mask;
+		while (m->table[i] != last) { i = (i + 1) & mask; }
+		m->table[i] = idx;
+		m->entries[idx] = m->entries[last];
+	}
+	return 1;
+}
+
+/*
+ * Builtins
+ */
+
+// (map-new {{key value} ...})
+lval* builtin_map_new(__attribute__((unused)) lenv* e, lval* a)
+{
+	LASSERT_NUM("map-new", a, 1);
+	LASSERT_TYPE("map-new", a, 0, LVAL_QEXPR);
+
+	lval* pairs = a->cell[0];
+	for (int i = 0; i < pairs->count; i++)
+	{
+		lval* p = pairs->cell[i];
+		LASSERT(a, p->type == LVAL_QEXPR && p->count == 2,
+			"Function 'map-new' expected {key value} pairs, element %i is not one.", i);
+		LASSERT(a, lmap_key_ok(p->cell[0]),
+			"Function 'map-new' passed a %s key at %i, keys are numbers, "
+			"strings, symbols, booleans or q-expressions of those.",
+			ltype_name(p->cell[0]->type), i);
+	}
+
+	lval* x = lval_map();
+	for (int i = 0; i < pairs->count; i++)
+	{
+		lval* p = pairs->cell[i];
+		lmap_put(x->map, lval_ref(p->cell[0]), lval_ref(p->cell[1]));
+	}
+
+	lval_del(a);
+	return x;
+}
+
+// (map-get map key) or (map-get map key default)
+lval* builtin_map_get(__attribute__((unused)) lenv* e, lval* a)
+{
+	LASSERT(a, a->count == 2 || a->count == 3,
+		"Function 'map-get' passed incorrect number of arguments. "
+		"Got %i, Expected 2 or 3.", a->count);
+	LASSERT_TYPE("map-get", a, 0, LVAL_MAP);
+
+	lval* v = lmap_get(a->cell[0]->map, a->cell[1]);
+	if (!v)
+	{
+		LASSERT(a, a->count == 3, "Function 'map-get' passed a key that is not in the map.");
+		return lval_take(a, 2);
+	}
+
+	v = lval_ref(v);
+	lval_del(a);
+	return v;
+}
+
+// (map-put map key value)
+lval* builtin_map_put(__attribute__((unused)) lenv* e, lval* a)
+{
+	LASSERT_NUM("map-put", a, 3);
+	LASSERT_TYPE("map-put", a, 0, LVAL_MAP);
+	LASSERT(a, lmap_key_ok(a->cell[1]),
+		"Function 'map-put' passed a %s key, keys are numbers, "
+		"strings, symbols, booleans or q-expressions of those.",
+		ltype_name(a->cell[1]->type));
+
+	lval* m = lval_own(lval_pop(a, 0));
+	lval* key = lval_pop(a, 0);
+	lval* val = lval_pop(a, 0);
+
+	lmap_put(m->map, key, val);
+	m->hash = 0;
+
+	lval_del(a);
+	return m;
+}
+
+// (map-del map key), a missing key leaves the map as it is
+lval* builtin_map_del(__attribute__((unused)) lenv* e, lval* a)
+{
+	LASSERT_NUM("map-del", a, 2);
+	LASSERT_TYPE("map-del", a, 0, LVAL_MAP);
+
+	lval* m = lval_pop(a, 0);
+	if (lmap_get(m->map, a->cell[0]))
+	{
+		m = lval_own(m);
+		lmap_remove(m->map, a->cell[0]);
+		m->hash = 0;
+	}
+
+	lval_del(a);
+	return m;
+}
+
+lval* builtin_map_keys(__attribute__((unused)) lenv* e, lval* a)
+{
+	LASSERT_NUM("map-keys", a, 1);
+	LASSERT_TYPE("map-keys", a, 0, LVAL_MAP);
+
+	lmap* m = a->cell[0]->map;
+	lval* x = lval_qexpr();
+	x->cell = malloc(sizeof(lval*) * m->count);
+	for (; x->count < m->count; x->count++)
+	{
+		x->cell[x->count] = lval_ref(m->entries[x->count].key);
+	}
+
+	lval_del(a);
+	return x;
+}
+
+lval* builtin_map_count(__attribute__((unused)) lenv* e, lval* a)
+{
+	LASSERT_NUM("map-count", a, 1);
+	LASSERT_TYPE("map-count", a, 0, LVAL_MAP);
+
+	lval* x = lval_num(a->cell[0]->map->count);
+	lval_del(a);
+	return x;
+}
@@ -0,0 +1,47 @@
+#ifndef MAP_H
+#define MAP_H
+
+typedef struct lval lval;
+typedef struct lenv lenv;
+
+/*
+ * Hash maps. Keys are numbers, strings, symbols, booleans
+ * or q-expressions of those: lval_hash picks the slot and
+ * lval_eq decides. Entries are kept dense, removal moves
+ * the last entry into the gap. A map with more than one
+ * owner is copied before it is changed, like any value.
+ */
+typedef struct lmap_entry
+{
+	unsigned long long hash;
+	lval* key;
+	lval* val;
+} lmap_entry;
+
+typedef struct lmap
+{
+	int count;
+	int cap;
+	lmap_entry* entries;
+
+	// open addressing over entry indices, -1 when empty
+	int* table;
+	int table_size;
+} lmap;
+
+lval* lval_map(void);
+lmap* lmap_copy(lmap*, lval*(*)(lval*));
+void lmap_del(lmap*);
+int lmap_key_ok(lval*);
+lval* lmap_get(lmap*, lval*);
+void lmap_put(lmap*, lval*, lval*);
+int lmap_remove(lmap*, lval*);
+
+lval* builtin_map_new(lenv*, lval*);
+lval* builtin_map_get(lenv*, lval*);
+lval* builtin_map_put(lenv*, lval*);
+lval* builtin_map_del(lenv*, lval*);
+lval* builtin_map_keys(lenv*, lval*);
+lval* builtin_map_count(lenv*, lval*);
+
+#endif
@@ -0,0 +1,271 @@
+#include "lval.h"
+#include "lenv.h"
+#include "memo.h"
+#include "builtins.h"
+#include "expressions.h"
+#include "common.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+lval* lval_memo(lval* fn, int size, int policy)
+{
+	lval* v = lval_new(LVAL_FUN);
+	v->builtin = NULL;
+	v->name = fn->name;
+	v->formals = NULL;
+	v->body = NULL;
+	v->fn = NULL;
+
+	lmemo* m = calloc(1, sizeof(lmemo));
+	m->fn = fn;
+	m->size = size;
+	m->policy = policy;
+	m->head = m->tail = -1;
+	v->memo = m;
+
+	return v;
+}
+
+void lmemo_del(lmemo* m)
+{
+	for (int i = 0; i < m->count; i++)
+	{
+		lval_del(m->entries[i].args);
+		lval_del(m->entries[i].result);
+	}
+	lval_del(m->fn);
+	free(m->entries);
+	free(m->table);
+	free(m);
+}
+
+/*
+ * Hash table
+ * Linear probing over entry indices, removal shifts the
+ * rest of the run back so no tombstones are needed.
+ */
+
+static int memo_find(lmemo* m, unsigned long long hash, lval* args)
+{
+	if (!m->table) { return -1; }
+
+	int mask = m->table_size - 1;
+	for (int i = hash & mask; m->table[i] != -1; i = (i + 1) & mask)
+	{
+		lmemo_entry* e = &m->entries[m->table[i]];
+		if (e->hash == hash && lval_eq(e->args, args)) { return m->table[i]; }
+	}
+	return -1;
+}
+
+static void table_insert(lmemo* m, int idx)
+{
+	int mask = m->table_size - 1;
+	int i = m->entries[idx].hash & mask;
+	while (m->table[i] != -1) { i = (i + 1) & mask; }
+	m->table[i] = idx;
+}
+
+static void table_remove(lmemo* m, int idx)
+{
+	int mask = m->table_size - 1;
+	int slot = m->entries[idx].hash & mask;
+	while (m->table[slot] != idx) { slot = (slot + 1) & mask; }
+	m->table[slot] = -1;
+
+	for (int j = (slot + 1) & mask; m->table[j] != -1; j = (j + 1) & mask)
+	{
+		int home = m->entries[m->table[j]].hash & mask;
+
+		// entries whose home lies cyclically in (slot, j] stay put
+		int stays = slot <= j ? (home > slot && home <= j) : (home > slot || home <= j);
+		if (!stays)
+		{
+			m->table[slot] = m->table[j];
+			m->table[j] = -1;
+			slot = j;
+		}
+	}
+}
+
+static void memo_grow(lmemo* m)
+{
+	int cap = m->cap ? m->cap * 2 : 16;
+	if (m->size && cap > m->size) { cap = m->size; }
+
+	m->entries = realloc(m->entries, sizeof(lmemo_entry) * cap);
+	m->cap = cap;
+
+	// at most half full
+	int table_size = 1;
+	while (table_size < cap * 2) { table_size *= 2; }
+
+	free(m->table);
+	m->table = malloc(sizeof(int) * table_size);
+	m->table_size = table_size;
+	for (int i = 0; i < table_size; i++) { m->table[i] = -1; }
+	for (int i = 0; i < m->count; i++) { table_insert(m, i); }
+}
+
+/*
+ * Recency
+ */
+
+static void lru_unlink(lmemo* m, int i)
+{
+	lmemo_entry* e = &m->entries[i];
+	if (e->prev != -1) { m->entries[e->prev].next = e->next; } else { m->head = e->next; }
+	if (e->next != -1) { m->entries[e->next].prev = e->prev; } else { m->tail = e->prev; }
+}
+
+static void lru_push(lmemo* m, int i)
+{
+	lmemo_entry* e = &m->entries[i];
+	e->prev = -1;
+	e->next = m->head;
+	if (m->head != -1) { m->entries[m->head].prev = i; } else { m->tail = i; }
+	m->head = i;
+}
+
+static void memo_touch(lmemo* m, int i)
+{
+	if (m->policy == MEMO_LRU)
+	{
+		lru_unlink(m, i);
+		lru_push(m, i);
+	} else {
+		m->entries[i].used = 1;
+	}
+}
+
+static int memo_victim(lmemo* m)
+{
+	if (m->policy == MEMO_LRU) { return m->tail; }
+
+	// clock: give every entry used since the last sweep a second chance
+	while (m->entries[m->hand].used)
+	{
+		m->entries[m->hand].used = 0;
+		m->hand = (m->hand + 1) % m->count;
+	}
+	int victim = m->hand;
+	m->hand = (m->hand + 1) % m->count;
+	return victim;
+}
+
+static void memo_insert(lmemo* m, unsigned long long hash, lval* args, lval* result)
+{
+	int i;
+	if (m->size && m->count == m->size)
+	{
+		i = memo_victim(m);
+		table_remove(m, i);
+		lru_unlink(m, i);
+		lval_del(m->entries[i].args);
+		lval_del(m->entries[i].result);
+		m->evictions++;
+	} else {
+		if (m->count == m->cap) { memo_grow(m); }
+		i = m->count++;
+	}
+
+	lmemo_entry* e = &m->entries[i];
+	e->hash = hash;
+	e->args = args;
+	e->result = result;
+	e->used = 0;
+	table_insert(m, i);
+	lru_push(m, i);
+}
+
+lval* lval_call_memo(lenv* env, lval* f, lval* a)
+{
+	lmemo* m = f->memo;
+	unsigned long long hash = lval_hash(a);
+
+	int i = memo_find(m, hash, a);
+	if (i != -1)
+	{
+		m->hits++;
+		memo_touch(m, i);
+		lval_del(a);
+		return lval_ref(m->entries[i].result);
+	}
+	m->misses++;
+
+	// the call consumes a, keep the arguments shared for the key
+	lval* args = lval_sexpr();
+	args->count = a->count;
+	args->cell = malloc(sizeof(lval*) * a->count);
+	for (int j = 0; j < a->count; j++) { args->cell[j] = lval_ref(a->cell[j]); }
+
+	lval* result = lval_call(env, m->fn, a);
+
+	// errors are not remembered, and a recursive call may
+	// have filled in the same arguments in the meantime
+	if (result->type == LVAL_ERR || memo_find(m, hash, args) != -1)
+	{
+		lval_del(args);
+		return result;
+	}
+
+	memo_insert(m, hash, args, lval_ref(result));
+	return result;
+}
+
+lval* builtin_memo(__attribute__((unused)) lenv* e, lval* a)
+{
+	LASSERT(a, a->count >= 1 && a->count <= 3,
+		"Function 'memo' passed incorrect number of arguments. "
+		"Got %i, Expected 1 to 3.", a->count);
+	LASSERT_TYPE("memo", a, 0, LVAL_FUN);
+
+	int size = MEMO_DEFAULT_SIZE;
+	if (a->count >= 2)
+	{
+		LASSERT_TYPE("memo", a, 1, LVAL_NUM);
+		LASSERT(a, a->cell[1]->num >= 0 && a->cell[1]->num <= 1 << 30,
+			"Function 'memo' passed invalid size %li.", a->cell[1]->num);
+		size = a->cell[1]->num;
+	}
+
+	int policy = MEMO_CLOCK;
+	if (a->count == 3)
+	{
+		LASSERT_TYPE("memo", a, 2, LVAL_STR);
+		lval_cstr(a->cell[2]);
+		LASSERT(a, strcmp(a->cell[2]->str, "lru") == 0 || strcmp(a->cell[2]->str, "clock") == 0,
+			"Function 'memo' passed unknown eviction \"%s\", expected \"lru\" or \"clock\".",
+			a->cell[2]->str);
+		policy = strcmp(a->cell[2]->str, "lru") == 0 ? MEMO_LRU : MEMO_CLOCK;
+	}
+
+	lval* fn = lval_pop(a, 0);
+	lval_del(a);
+	return lval_memo(fn, size, policy);
+}
+
+lval* builtin_memo_stats(__attribute__((unused)) lenv* e, lval* a)
+{
+	LASSERT_NUM("memo-stats", a, 1);
+	LASSERT_TYPE("memo-stats", a, 0, LVAL_FUN);
+	LASSERT(a, a->cell[0]->memo,
+		"Function 'memo-stats' passed a function that is not memoized.");
+
+	lmemo* m = a->cell[0]->memo;
+	char* names[] = { "hits", "misses", "evictions", "count", "size" };
+	long values[] = { m->hits, m->misses, m->evictions, m->count, m->size };
+
+	lval* x = lval_qexpr();
+	for (int i = 0; i < 5; i++)
+	{
+		lval* pair = lval_qexpr();
+		pair = lval_add(pair, lval_sym(names[i]));
+		pair = lval_add(pair, lval_num(values[i]));
+		x = lval_add(x, pair);
+	}
+
+	lval_del(a);
+	return x;
+}
@@ -0,0 +1,63 @@
+#ifndef MEMO_H
+#define MEMO_H
+
+typedef struct lval lval;
+typedef struct lenv lenv;
+
+/*
+ * Memoized functions. A memo is a function value wrapping
+ * another function with a cache of results keyed on the
+ * arguments: lval_hash picks the slot, lval_eq decides.
+ * The cache changes on every call, but what the function
+ * returns does not, so the value counts as immutable.
+ */
+enum { MEMO_CLOCK, MEMO_LRU };
+
+#define MEMO_DEFAULT_SIZE 1024
+
+typedef struct lmemo_entry
+{
+	unsigned long long hash;
+	lval* args;
+	lval* result;
+
+	// recency list for LRU, most recent at the head
+	int prev;
+	int next;
+
+	// reference bit for clock
+	char used;
+} lmemo_entry;
+
+typedef struct lmemo
+{
+	lval* fn;
+	int policy;
+	// most entries kept, 0 for no limit
+	int size;
+
+	int count;
+	int cap;
+	lmemo_entry* entries;
+
+	// open addressing over entry indices, -1 when empty
+	int* table;
+	int table_size;
+
+	int head;
+	int tail;
+	int hand;
+
+	long hits;
+	long misses;
+	long evictions;
+} lmemo;
+
+lval* lval_memo(lval*, int, int);
+void lmemo_del(lmemo*);
+lval* lval_call_memo(lenv*, lval*, lval*);
+
+lval* builtin_memo(lenv*, lval*);
+lval* builtin_memo_stats(lenv*, lval*);
+
+#endif
@@ -0,0 +1,70 @@
+#include "mpc.h"
+#include "lenv.h"
+#include "lval.h"
+#include "semantics.h"
+#include "expressions.h"
+#include "builtins.h"
+#include "serialize.h"
+#include "profile.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+ * Build step that loads the prelude and writes the
+ * resulting global env as a C byte array, so the
+ * interpreter can install it without parsing.
+ *
+ * usage: mkprelude prelude.phi prelude_data.c
+ */
+int main(int argc, char** argv)
+{
+	if (argc != 3)
+	{
+		fprintf(stderr, "usage: %s prelude.phi prelude_data.c\n", argv[0]);
+		return 1;
+	}
+
+	parser_elements* _parser_elements = get_parser();
+
+	lenv* env = lenv_new();
+	lenv_add_builtins(env);
+	env->phi = _parser_elements->Phi;
+
+	// the build should leave no prelude.phic in the source tree
+	lval_cache_enabled = 0;
+
+	lval* x = builtin_load(env, lval_add(lval_sexpr(), lval_str(argv[1])));
+	int ok = x->type != LVAL_ERR;
+	if (!ok) { lval_println(x); }
+	lval_del(x);
+
+	sbuf b = {0};
+	ok = ok && lenv_image_encode(&b, env);
+
+	FILE* f = ok ? fopen(argv[2], "w") : NULL;
+	if (f)
+	{
+		fprintf(f, "/* Generated by mkprelude from %s, do not edit. */\n", argv[1]);
+		fprintf(f, "#include \"prelude.h\"\n\n");
+		fprintf(f, "const unsigned char prelude_image[] =\n{");
+		for (size_t i = 0; i < b.len; i++)
+		{
+			fprintf(f, "%s0x%02x,", i % 12 ? " " : "\n\t", (unsigned char) b.data[i]);
+		}
+		fprintf(f, "\n};\n\n");
+		fprintf(f, "const size_t prelude_image_len = %zu;\n", b.len);
+		ok = fclose(f) == 0;
+	} else {
+		fprintf(stderr, "Could not write %s\n", argv[2]);
+		ok = 0;
+	}
+
+	free(b.data);
+	env->phi = NULL;
+	lenv_del(env);
+	free_parsers(_parser_elements);
+	profile_free();
+
+	return ok ? 0 : 1;
+}
@@ -562,6 +562,84 @@ static int mpc_input_eoi(mpc_input_t* i, char **o) {
   }
 }
 
+/*
+** Regular expressions that only use features
+** expressible as a finite automaton, and whose
+** longest match is the one the parser finds, are
+** also compiled into a transition table (see the
+** Regular Expression Parsers below). Matching
+** a token against it is then a single loop
+** over the input string which keeps track of
+** the longest accepted prefix.
+**
+** Row `s` of `trans` holds the next state for
+** every input byte, or -1 when the match is
+** over. State 0 is the start state.
+*/
+
+typedef struct {
+  int states_num;
+  int *trans;
+  char *accept;
+  char *expected;
+} mpc_dfa_t;
+
+static long mpc_dfa_match(mpc_dfa_t *d, const char *s) {
+  const unsigned char *p = (const unsigned char*)s;
+  int state = 0;
+  long j = 0, last = d->accept[0] ? 0 : -1;
+  while (p[j]) {
+    state = d->trans[state * 256 + p[j]];
+    if (state < 0) { break; }
+    j++;
+    if (d->accept[state]) { last = j; }
+  }
+  return last;
+}
+
+static int mpc_input_dfa(mpc_input_t *i, mpc_dfa_t *d, char **o) {
+
+  const char *s = i->string + i->state.pos;
+  long j, n = mpc_dfa_match(d, s);
+
+  if (n < 0) { return 0; }
+
+  for (j = 0; j < n; j++) {
+    i->state.col++;
+    if (s[j] == '\n') {
+      i->state.col = 0;
+      i->state.row++;
+    }
+  }
+
+  if (n > 0) { i->last = s[n-1]; }
+  i->state.pos += n;
+
+  *o = mpc_malloc(i, n + 1);
+  memcpy(*o, s, n);
+  (*o)[n] = '\0';
+  return 1;
+}
+
+static mpc_dfa_t *mpc_dfa_copy(mpc_dfa_t *d) {
+  mpc_dfa_t *c = malloc(sizeof(mpc_dfa_t));
+  c->states_num = d->states_num;
+  c->trans = malloc(sizeof(int) * 256 * d->states_num);
+  c->accept = malloc(d->states_num);
+  memcpy(c->trans, d->trans, sizeof(int) * 256 * d->states_num);
+  memcpy(c->accept, d->accept, d->states_num);
+  c->expected = malloc(strlen(d->expected) + 1);
+  strcpy(c->expected, d->expected);
+  return c;
+}
+
+static void mpc_dfa_delete(mpc_dfa_t *d) {
+  free(d->trans);
+  free(d->accept);
+  free(d->expected);
+  free(d);
+}
+
 static mpc_state_t *mpc_input_state_copy(mpc_input_t *i) {
   mpc_state_t *r = mpc_malloc(i, sizeof(mpc_state_t));
   memcpy(r, &i->state, sizeof(mpc_state_t));
@@ -876,6 +954,110 @@ static mpc_err_t *mpc_err_merge(mpc_input_t *i, mpc_err_t *x, mpc_err_t *y) {
   return mpc_err_or(i, errs, 2);
 }
 
+/*
+** AST Arena
+**
+** While a parse is running, every AST node along with
+** its tag, contents and children array is allocated
+** from an arena belonging to that parse rather than
+** with individual mallocs.
+**
+** If the result of the parse is a node from the arena
+** it becomes the arena's root, and `mpc_ast_delete` on
+** it releases all the blocks at once. Deleting any
+** other arena node does nothing, which is what happens
+** to partial results thrown away while backtracking.
+** Otherwise the arena is released when the parse ends,
+** so ASTs must be returned as the parse result (as all
+** `mpca` grammars do) to outlive it.
+**
+** Nodes created outside of a parse are heap allocated
+** and deleted recursively as before.
+*/
+
+typedef struct mpc_ast_block_t {
+  struct mpc_ast_block_t *next;
+  size_t used;
+  size_t size;
+} mpc_ast_block_t;
+
+struct mpc_ast_arena_t {
+  mpc_ast_block_t *blocks;
+  mpc_ast_t *root;
+};
+
+enum {
+  MPC_AST_BLOCK_MIN    = 16384,
+  MPC_AST_CHILDREN_MIN = 4
+};
+
+#define MPC_AST_ALIGN(n) (((n) + 15) & ~(size_t)15)
+
+static mpc_ast_arena_t *mpc_ast_arena_curr = NULL;
+
+static mpc_ast_arena_t *mpc_ast_arena_new(void) {
+  mpc_ast_arena_t *a = malloc(sizeof(mpc_ast_arena_t));
+  a->blocks = NULL;
+  a->root = NULL;
+  return a;
+}
+
+static void mpc_ast_arena_delete(mpc_ast_arena_t *a) {
+  mpc_ast_block_t *b = a->blocks, *n;
+  while (b) {
+    n = b->next;
+    free(b);
+    b = n;
+  }
+  free(a);
+}
+
+static void *mpc_ast_arena_alloc(mpc_ast_arena_t *a, size_t n) {
+
+  mpc_ast_block_t *b = a->blocks;
+  size_t size;
+  void *p;
+
+  n = MPC_AST_ALIGN(n);
+
+  if (b == NULL || b->used + n > b->size) {
+    size = b ? b->size * 2 : MPC_AST_BLOCK_MIN;
+    while (size < n) { size *= 2; }
+    b = malloc(MPC_AST_ALIGN(sizeof(mpc_ast_block_t)) + size);
+    b->next = a->blocks;
+    b->used = 0;
+    b->size = size;
+    a->blocks = b;
+  }
+
+  p = (char*)b + MPC_AST_ALIGN(sizeof(mpc_ast_block_t)) + b->used;
+  b->used += n;
+  return p;
+}
+
+static int mpc_ast_arena_owns(mpc_ast_arena_t *a, void *p) {
+  mpc_ast_block_t *b;
+  char *start;
+  for (b = a->blocks; b; b = b->next) {
+    start = (char*)b + MPC_AST_ALIGN(sizeof(mpc_ast_block_t));
+    if ((char*)p >= start && (char*)p < start + b->used) { return 1; }
+  }
+  return 0;
+}
+
+static void *mpc_ast_malloc(mpc_ast_arena_t *a, size_t n) {
+  return a ? mpc_ast_arena_alloc(a, n) : malloc(n);
+}
+
+static void *mpc_ast_realloc(mpc_ast_arena_t *a, void *p, size_t old, size_t n) {
+  void *q;
+  if (a == NULL) { return realloc(p, n); }
+  if (n <= old) { return p; }
+  q = mpc_ast_arena_alloc(a, n);
+  if (p) { memcpy(q, p, old); }
+  return q;
+}
+
 /*
 ** Parser Type
 */
@@ -914,7 +1096,9 @@ enum {
   MPC_TYPE_CHECK_WITH = 26,
 
   MPC_TYPE_SOI        = 27,
-  MPC_TYPE_EOI        = 28
+  MPC_TYPE_EOI        = 28,
+
+  MPC_TYPE_DFA        = 29
 };
 
 typedef struct { char *m; } mpc_pdata_fail_t;
@@ -934,6 +1118,7 @@ typedef struct { mpc_parser_t *x; mpc_dtor_t dx; mpc_ctor_t lf; } mpc_pdata_not_
 typedef struct { int n; mpc_fold_t f; mpc_parser_t *x; mpc_dtor_t dx; } mpc_pdata_repeat_t;
 typedef struct { int n; mpc_parser_t **xs; } mpc_pdata_or_t;
 typedef struct { int n; mpc_fold_t f; mpc_parser_t **xs; mpc_dtor_t *dxs;  } mpc_pdata_and_t;
+typedef struct { mpc_dfa_t *d; mpc_parser_t *x; } mpc_pdata_dfa_t;
 
 typedef union {
   mpc_pdata_fail_t fail;
@@ -953,6 +1138,7 @@ typedef union {
   mpc_pdata_repeat_t repeat;
   mpc_pdata_and_t and;
   mpc_pdata_or_t or;
+  mpc_pdata_dfa_t dfa;
 } mpc_pdata_t;
 
 struct mpc_parser_t {
@@ -960,6 +1146,7 @@ struct mpc_parser_t {
   mpc_pdata_t data;
   char type;
   char retained;
+  int rule;
 };
 
 static mpc_val_t *mpcf_input_nth_free(mpc_input_t *i, int n, mpc_val_t **xs, int x) {
@@ -1071,6 +1258,22 @@ static int mpc_parse_run(mpc_input_t *i, mpc_parser_t *p, mpc_result_t *r, mpc_e
     case MPC_TYPE_SOI:     MPC_PRIMITIVE(mpc_input_soi(i, (char**)&r->output));
     case MPC_TYPE_EOI:     MPC_PRIMITIVE(mpc_input_eoi(i, (char**)&r->output));
 
+    /* Compiled Regular Expressions */
+
+    case MPC_TYPE_DFA:
+      if (i->type == MPC_INPUT_STRING) {
+        if (mpc_input_dfa(i, p->data.dfa.d, (char**)&r->output)) {
+          MPC_SUCCESS(r->output);
+        } else {
+          MPC_FAILURE(mpc_err_new(i, p->data.dfa.d->expected));
+        }
+      }
+      if (mpc_parse_run(i, p->data.dfa.x, r, e, depth+1)) {
+        MPC_SUCCESS(r->output);
+      } else {
+        MPC_FAILURE(r->error);
+      }
+
     /* Other parsers */
 
     case MPC_TYPE_UNDEFINED: MPC_FAILURE(mpc_err_fail(i, "Parser Undefined!"));
@@ -1306,15 +1509,24 @@ static int mpc_parse_run(mpc_input_t *i, mpc_parser_t *p, mpc_result_t *r, mpc_e
 
 int mpc_parse_input(mpc_input_t *i, mpc_parser_t *p, mpc_result_t *r) {
   int x;
+  mpc_ast_arena_t *prev = mpc_ast_arena_curr;
+  mpc_ast_arena_t *arena = mpc_ast_arena_new();
   mpc_err_t *e = mpc_err_fail(i, "Unknown Error");
   e->state = mpc_state_invalid();
+  mpc_ast_arena_curr = arena;
   x = mpc_parse_run(i, p, r, &e, 0);
+  mpc_ast_arena_curr = prev;
   if (x) {
     mpc_err_delete_internal(i, e);
     r->output = mpc_export(i, r->output);
   } else {
     r->error = mpc_err_export(i, mpc_err_merge(i, e, r->error));
   }
+  if (x && mpc_ast_arena_owns(arena, r->output)) {
+    arena->root = r->output;
+  } else {
+    mpc_ast_arena_delete(arena);
+  }
   return x;
 }
 
@@ -1353,6 +1565,8 @@ int mpc_parse_pipe(const char *filename, FILE *pipe, mpc_parser_t *p, mpc_result
 int mpc_parse_contents(const char *filename, mpc_parser_t *p, mpc_result_t *r) {
 
   FILE *f = fopen(filename, "rb");
+  char *buffer;
+  long length;
   int res;
 
   if (f == NULL) {
@@ -1361,8 +1575,26 @@ int mpc_parse_contents(const char *filename, mpc_parser_t *p, mpc_result_t *r) {
     return 0;
   }
 
-  res = mpc_parse_file(filename, f, p, r);
+  /*
+  ** Read the whole file so it is parsed as a string. Seeking
+  ** around a FILE on every backtrack is slow, and compiled
+  ** regular expressions can only scan string input directly.
+  */
+  if (fseek(f, 0, SEEK_END) != 0 || (length = ftell(f)) < 0) {
+    rewind(f);
+    res = mpc_parse_file(filename, f, p, r);
+    fclose(f);
+    return res;
+  }
+
+  rewind(f);
+  buffer = malloc(length + 1);
+  length = (long)fread(buffer, 1, length, f);
+  buffer[length] = '\0';
   fclose(f);
+
+  res = mpc_nparse(filename, buffer, length, p, r);
+  free(buffer);
   return res;
 }
 
@@ -1440,6 +1672,11 @@ static void mpc_undefine_unretained(mpc_parser_t *p, int force) {
       free(p->data.check_with.e);
       break;
 
+    case MPC_TYPE_DFA:
+      mpc_undefine_unretained(p->data.dfa.x, 0);
+      mpc_dfa_delete(p->data.dfa.d);
+      break;
+
     default: break;
   }
 
@@ -1485,6 +1722,20 @@ mpc_parser_t *mpc_new(const char *name) {
   return p;
 }
 
+/*
+** Gives a named rule an integer id. Wherever an `mpca`
+** grammar refers to the rule, the AST node it produces
+** has `rule` set to this id (the innermost rule wins),
+** so that a tree can be walked with a `switch` instead
+** of string comparisons on tags. Nodes carrying an id
+** are never merged into their parent.
+*/
+
+mpc_parser_t *mpc_rule_id(mpc_parser_t *p, int id) {
+  p->rule = id;
+  return p;
+}
+
 mpc_parser_t *mpc_copy(mpc_parser_t *a) {
   int i = 0;
   mpc_parser_t *p;
@@ -1493,6 +1744,7 @@ mpc_parser_t *mpc_copy(mpc_parser_t *a) {
 
   p = mpc_undefined();
   p->retained = a->retained;
+  p->rule = a->rule;
   p->type = a->type;
   p->data = a->data;
 
@@ -1564,6 +1816,11 @@ mpc_parser_t *mpc_copy(mpc_parser_t *a) {
       strcpy(p->data.check_with.e, a->data.check_with.e);
       break;
 
+    case MPC_TYPE_DFA:
+      p->data.dfa.x = mpc_copy(a->data.dfa.x);
+      p->data.dfa.d = mpc_dfa_copy(a->data.dfa.d);
+      break;
+
     default: break;
   }
 
@@ -2350,6 +2607,482 @@ static mpc_val_t *mpcf_re_range(mpc_val_t *x) {
   return out;
 }
 
+/*
+** Regular Expression Compilation
+**
+** As well as building the parser above, `mpc_re_mode`
+** tries to compile the expression into a DFA. This is
+** a second small recursive descent over the same regex
+** grammar which builds a Thompson NFA, followed by the
+** usual subset construction.
+**
+** Anything that is not a plain automaton - the `^` and
+** `$` anchors, word boundaries, and the negated escapes
+** which mpc implements as lookaheads - makes compilation
+** give up, and only the combinator parser is used.
+**
+** The DFA reports the longest match, while the parser
+** commits to the first alternative that succeeds and
+** repeats as often as it can without giving any back.
+** The two only agree when every choice can be made by
+** looking at the next byte, so compilation also gives
+** up when
+**
+**   - two alternatives can start with the same byte,
+**   - an alternative other than the last can be empty,
+**   - a repeated expression can be empty, or
+**   - a repeated or optional part could go on with a
+**     byte that can also start what follows it.
+**
+** `"(\\.|[^"])*"` is one of these: a backslash starts
+** both alternatives, and on `"a\\" "` the parser stops
+** at the second quote where the longest match would run
+** on to the third.
+*/
+
+enum {
+  MPC_NFA_EPSILON = 0,
+  MPC_NFA_SET     = 1
+};
+
+enum {
+  MPC_NFA_STATES_MAX = 4096,
+  MPC_DFA_STATES_MAX = 512
+};
+
+typedef struct {
+  char type;
+  int out;
+  int out1;
+  unsigned char set[32];
+} mpc_nfa_state_t;
+
+typedef struct {
+  const char *re;
+  int pos;
+  int mode;
+  int error;
+  int states_num;
+  int states_slots;
+  mpc_nfa_state_t *states;
+} mpc_nfa_t;
+
+/*
+** Besides its states a fragment knows the bytes a match
+** of it can start with, the bytes that could carry on a
+** match after it has ended, and whether it can be empty.
+*/
+
+typedef struct {
+  int start;
+  int end;
+  int nullable;
+  unsigned char first[32];
+  unsigned char last[32];
+} mpc_nfa_frag_t;
+
+static void mpc_nfa_set_add(unsigned char *set, int c) { set[c / 8] |= (unsigned char)(1 << (c % 8)); }
+static int mpc_nfa_set_has(const unsigned char *set, int c) { return set[c / 8] & (1 << (c % 8)); }
+
+static void mpc_nfa_set_add_all(unsigned char *set, const char *cs) {
+  while (*cs) { mpc_nfa_set_add(set, (unsigned char)*cs); cs++; }
+}
+
+static void mpc_nfa_set_union(unsigned char *set, const unsigned char *other) {
+  int j;
+  for (j = 0; j < 32; j++) { set[j] |= other[j]; }
+}
+
+static int mpc_nfa_set_meets(const unsigned char *set, const unsigned char *other) {
+  int j;
+  for (j = 0; j < 32; j++) { if (set[j] & other[j]) { return 1; } }
+  return 0;
+}
+
+static int mpc_nfa_state(mpc_nfa_t *n, char type) {
+
+  mpc_nfa_state_t *s;
+
+  if (n->states_num == MPC_NFA_STATES_MAX) { n->error = 1; return 0; }
+
+  if (n->states_num == n->states_slots) {
+    n->states_slots = n->states_slots ? n->states_slots * 2 : 32;
+    n->states = realloc(n->states, sizeof(mpc_nfa_state_t) * n->states_slots);
+  }
+
+  s = &n->states[n->states_num];
+  s->type = type;
+  s->out = -1;
+  s->out1 = -1;
+  memset(s->set, 0, sizeof(s->set));
+  return n->states_num++;
+}
+
+static mpc_nfa_frag_t mpc_nfa_frag(int start, int end) {
+  mpc_nfa_frag_t f;
+  f.start = start;
+  f.end = end;
+  f.nullable = 0;
+  memset(f.first, 0, sizeof(f.first));
+  memset(f.last, 0, sizeof(f.last));
+  return f;
+}
+
+/* Whatever can start an empty match can also carry it on */
+static mpc_nfa_frag_t mpc_nfa_frag_close(mpc_nfa_frag_t f) {
+  if (f.nullable) { mpc_nfa_set_union(f.last, f.first); }
+  return f;
+}
+
+static mpc_nfa_frag_t mpc_nfa_empty(mpc_nfa_t *n) {
+  int e = mpc_nfa_state(n, MPC_NFA_EPSILON);
+  mpc_nfa_frag_t f = mpc_nfa_frag(e, e);
+  f.nullable = 1;
+  return f;
+}
+
+static mpc_nfa_frag_t mpc_nfa_set(mpc_nfa_t *n, const unsigned char *set) {
+  int s = mpc_nfa_state(n, MPC_NFA_SET);
+  int e = mpc_nfa_state(n, MPC_NFA_EPSILON);
+  mpc_nfa_frag_t f;
+  if (n->error) { return mpc_nfa_frag(0, 0); }
+  memcpy(n->states[s].set, set, sizeof(n->states[s].set));
+  n->states[s].out = e;
+  f = mpc_nfa_frag(s, e);
+  memcpy(f.first, set, sizeof(f.first));
+  return f;
+}
+
+static mpc_nfa_frag_t mpc_nfa_cat(mpc_nfa_t *n, mpc_nfa_frag_t a, mpc_nfa_frag_t b) {
+  mpc_nfa_frag_t f;
+  if (n->error) { return a; }
+  if (mpc_nfa_set_meets(a.last, b.first)) { n->error = 1; return a; }
+  n->states[a.end].out = b.start;
+  f = mpc_nfa_frag(a.start, b.end);
+  f.nullable = a.nullable && b.nullable;
+  mpc_nfa_set_union(f.first, a.first);
+  if (a.nullable) { mpc_nfa_set_union(f.first, b.first); }
+  mpc_nfa_set_union(f.last, b.last);
+  if (b.nullable) { mpc_nfa_set_union(f.last, a.last); }
+  return mpc_nfa_frag_close(f);
+}
+
+static mpc_nfa_frag_t mpc_nfa_alt(mpc_nfa_t *n, mpc_nfa_frag_t a, mpc_nfa_frag_t b) {
+  int s = mpc_nfa_state(n, MPC_NFA_EPSILON);
+  int e = mpc_nfa_state(n, MPC_NFA_EPSILON);
+  mpc_nfa_frag_t f;
+  if (n->error) { return a; }
+  if (a.nullable || mpc_nfa_set_meets(a.first, b.first)) { n->error = 1; return a; }
+  n->states[s].out = a.start;
+  n->states[s].out1 = b.start;
+  n->states[a.end].out = e;
+  n->states[b.end].out = e;
+  f = mpc_nfa_frag(s, e);
+  f.nullable = b.nullable;
+  mpc_nfa_set_union(f.first, a.first);
+  mpc_nfa_set_union(f.first, b.first);
+  mpc_nfa_set_union(f.last, a.last);
+  mpc_nfa_set_union(f.last, b.last);
+  return mpc_nfa_frag_close(f);
+}
+
+static mpc_nfa_frag_t mpc_nfa_repeat(mpc_nfa_t *n, mpc_nfa_frag_t a, char op) {
+  int s = mpc_nfa_state(n, MPC_NFA_EPSILON);
+  int e = mpc_nfa_state(n, MPC_NFA_EPSILON);
+  mpc_nfa_frag_t f;
+  if (n->error) { return a; }
+  if (a.nullable || (op != '?' && mpc_nfa_set_meets(a.last, a.first))) { n->error = 1; return a; }
+  n->states[s].out = a.start;
+  n->states[s].out1 = e;
+  switch (op) {
+    case '*': n->states[a.end].out = s; f = mpc_nfa_frag(s, e); break;
+    case '+': n->states[a.end].out = s; f = mpc_nfa_frag(a.start, e); break;
+    default:  n->states[a.end].out = e; f = mpc_nfa_frag(s, e); break;
+  }
+  f.nullable = op != '+';
+  memcpy(f.first, a.first, sizeof(f.first));
+  memcpy(f.last, a.last, sizeof(f.last));
+  mpc_nfa_set_union(f.last, a.first);
+  return f;
+}
+
+/* Mirrors `mpcf_re_range` but builds a byte set */
+static void mpc_nfa_range(mpc_nfa_t *n, const char *s, unsigned char *set) {
+
+  size_t i, len = strlen(s);
+  int j, start, end;
+  const char *tmp;
+  int comp = s[0] == '^' ? 1 : 0;
+
+  if (s[0] == '\0' || (comp && s[1] == '\0')) { n->error = 1; return; }
+
+  for (i = comp; i < len; i++) {
+    if (s[i] == '\\') {
+      tmp = mpc_re_range_escape_char(s[i+1]);
+      if (tmp != NULL) { mpc_nfa_set_add_all(set, tmp); }
+      else { mpc_nfa_set_add(set, (unsigned char)s[i+1]); }
+      i++;
+    } else if (s[i] == '-') {
+      if (s[i+1] == '\0' || i == 0) {
+        mpc_nfa_set_add(set, '-');
+      } else {
+        start = (unsigned char)s[i-1] + 1;
+        end = (unsigned char)s[i+1] - 1;
+        for (j = start; j <= end; j++) { mpc_nfa_set_add(set, (unsigned char)j); }
+      }
+    } else {
+      mpc_nfa_set_add(set, (unsigned char)s[i]);
+    }
+  }
+
+  if (comp) {
+    for (j = 0; j < 32; j++) { set[j] = (unsigned char)~set[j]; }
+  }
+  set[0] &= (unsigned char)~1;
+}
+
+static mpc_nfa_frag_t mpc_nfa_regex(mpc_nfa_t *n);
+
+static mpc_nfa_frag_t mpc_nfa_base(mpc_nfa_t *n) {
+
+  unsigned char set[32];
+  mpc_nfa_frag_t f;
+  const char *re = n->re;
+  char *range;
+  int j, start;
+  char c = re[n->pos];
+
+  memset(set, 0, sizeof(set));
+
+  switch (c) {
+
+    case '(':
+      n->pos++;
+      f = mpc_nfa_regex(n);
+      if (re[n->pos] != ')') { n->error = 1; return f; }
+      n->pos++;
+      return f;
+
+    case '[':
+      start = ++n->pos;
+      while (re[n->pos] != ']') {
+        if (re[n->pos] == '\0') { n->error = 1; return mpc_nfa_empty(n); }
+        if (re[n->pos] == '\\' && re[n->pos+1] != '\0') { n->pos++; }
+        n->pos++;
+      }
+      range = malloc(n->pos - start + 1);
+      memcpy(range, re + start, n->pos - start);
+      range[n->pos - start] = '\0';
+      mpc_nfa_range(n, range, set);
+      free(range);
+      n->pos++;
+      return mpc_nfa_set(n, set);
+
+    case '\\':
+      n->pos += 2;
+      switch (re[n->pos-1]) {
+        case '\0': n->error = 1; n->pos--; break;
+        case 'a': mpc_nfa_set_add(set, '\a'); break;
+        case 'f': mpc_nfa_set_add(set, '\f'); break;
+        case 'n': mpc_nfa_set_add(set, '\n'); break;
+        case 'r': mpc_nfa_set_add(set, '\r'); break;
+        case 't': mpc_nfa_set_add(set, '\t'); break;
+        case 'v': mpc_nfa_set_add(set, '\v'); break;
+        case 'd': mpc_nfa_set_add_all(set, "0123456789"); break;
+        case 's': mpc_nfa_set_add_all(set, " \f\n\r\t\v"); break;
+        case 'w': mpc_nfa_set_add_all(set, "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_"); break;
+        case 'b': case 'B': case 'A': case 'Z':
+        case 'D': case 'S': case 'W':
+          n->error = 1; break;
+        default: mpc_nfa_set_add(set, (unsigned char)re[n->pos-1]); break;
+      }
+      return mpc_nfa_set(n, set);
+
+    case '.':
+      n->pos++;
+      for (j = 1; j < 256; j++) { mpc_nfa_set_add(set, (unsigned char)j); }
+      if (!(n->mode & MPC_RE_DOTALL)) { set['\n' / 8] &= (unsigned char)~(1 << ('\n' % 8)); }
+      return mpc_nfa_set(n, set);
+
+    case '^':
+    case '$':
+      n->error = 1;
+      return mpc_nfa_empty(n);
+
+    default:
+      n->pos++;
+      mpc_nfa_set_add(set, (unsigned char)c);
+      return mpc_nfa_set(n, set);
+  }
+}
+
+static mpc_nfa_frag_t mpc_nfa_factor(mpc_nfa_t *n) {
+
+  const char *re = n->re;
+  int start = n->pos, end, j, num = 0;
+  mpc_nfa_frag_t f = mpc_nfa_base(n);
+
+  switch (re[n->pos]) {
+    case '*':
+    case '+':
+    case '?':
+      n->pos++;
+      return mpc_nfa_repeat(n, f, re[n->pos-1]);
+    case '{':
+      end = n->pos + 1;
+      if (!isdigit((unsigned char)re[end])) { return f; }
+      while (isdigit((unsigned char)re[end])) { num = num * 10 + (re[end] - '0'); end++; }
+      if (re[end] != '}') { return f; }
+      if (num == 0) { n->error = 1; return f; }
+      /* Build the remaining copies by re-reading the base */
+      for (j = 1; j < num && !n->error; j++) {
+        n->pos = start;
+        f = mpc_nfa_cat(n, f, mpc_nfa_base(n));
+      }
+      n->pos = end + 1;
+      return f;
+    default:
+      return f;
+  }
+}
+
+static mpc_nfa_frag_t mpc_nfa_term(mpc_nfa_t *n) {
+  mpc_nfa_frag_t f = mpc_nfa_empty(n);
+  char c = n->re[n->pos];
+  while (c != '\0' && c != ')' && c != '|' && !n->error) {
+    f = mpc_nfa_cat(n, f, mpc_nfa_factor(n));
+    c = n->re[n->pos];
+  }
+  return f;
+}
+
+static mpc_nfa_frag_t mpc_nfa_regex(mpc_nfa_t *n) {
+  mpc_nfa_frag_t f = mpc_nfa_term(n);
+  if (n->re[n->pos] == '|' && !n->error) {
+    n->pos++;
+    f = mpc_nfa_alt(n, f, mpc_nfa_regex(n));
+  }
+  return f;
+}
+
+static void mpc_nfa_closure(mpc_nfa_t *n, unsigned char *set, int *stack) {
+
+  int j, s, top = 0;
+
+  for (j = 0; j < n->states_num; j++) {
+    if (mpc_nfa_set_has(set, j)) { stack[top++] = j; }
+  }
+
+  while (top) {
+    s = stack[--top];
+    if (n->states[s].type != MPC_NFA_EPSILON) { continue; }
+    if (n->states[s].out >= 0 && !mpc_nfa_set_has(set, n->states[s].out)) {
+      mpc_nfa_set_add(set, n->states[s].out);
+      stack[top++] = n->states[s].out;
+    }
+    if (n->states[s].out1 >= 0 && !mpc_nfa_set_has(set, n->states[s].out1)) {
+      mpc_nfa_set_add(set, n->states[s].out1);
+      stack[top++] = n->states[s].out1;
+    }
+  }
+}
+
+static mpc_dfa_t *mpc_dfa_compile(const char *re, int mode) {
+
+  mpc_nfa_t n;
+  mpc_nfa_frag_t f;
+  mpc_dfa_t *d = NULL;
+  unsigned char *sets, *next;
+  int *stack;
+  int setsize, states_num = 1, s, c, j, k, found;
+
+  n.re = re;
+  n.pos = 0;
+  n.mode = mode;
+  n.error = 0;
+  n.states_num = 0;
+  n.states_slots = 0;
+  n.states = NULL;
+
+  f = mpc_nfa_regex(&n);
+  if (n.error || re[n.pos] != '\0') { free(n.states); return NULL; }
+
+  /* Subset construction - DFA states are bitsets of NFA states */
+
+  setsize = n.states_num / 8 + 1;
+  sets = calloc(MPC_DFA_STATES_MAX, setsize);
+  next = malloc(setsize);
+  stack = malloc(sizeof(int) * n.states_num * 2);
+
+  d = malloc(sizeof(mpc_dfa_t));
+  d->trans = malloc(sizeof(int) * 256 * MPC_DFA_STATES_MAX);
+  d->accept = malloc(MPC_DFA_STATES_MAX);
+  d->expected = malloc(strlen(re) + 3);
+  sprintf(d->expected, "/%s/", re);
+
+  mpc_nfa_set_add(sets, f.start);
+  mpc_nfa_closure(&n, sets, stack);
+
+  for (s = 0; s < states_num; s++) {
+
+    d->accept[s] = mpc_nfa_set_has(sets + s * setsize, f.end) ? 1 : 0;
+    d->trans[s * 256] = -1;
+
+    for (c = 1; c < 256; c++) {
+
+      memset(next, 0, setsize);
+      found = 0;
+      for (j = 0; j < n.states_num; j++) {
+        if (mpc_nfa_set_has(sets + s * setsize, j)
+        &&  n.states[j].type == MPC_NFA_SET
+        &&  mpc_nfa_set_has(n.states[j].set, (unsigned char)c)) {
+          mpc_nfa_set_add(next, n.states[j].out);
+          found = 1;
+        }
+      }
+
+      if (!found) { d->trans[s * 256 + c] = -1; continue; }
+
+      mpc_nfa_closure(&n, next, stack);
+
+      for (k = 0; k < states_num; k++) {
+        if (memcmp(sets + k * setsize, next, setsize) == 0) { break; }
+      }
+
+      if (k == states_num) {
+        if (states_num == MPC_DFA_STATES_MAX) {
+          free(sets); free(next); free(stack); free(n.states);
+          mpc_dfa_delete(d);
+          return NULL;
+        }
+        memcpy(sets + k * setsize, next, setsize);
+        states_num++;
+      }
+
+      d->trans[s * 256 + c] = k;
+    }
+  }
+
+  d->states_num = states_num;
+  d->trans = realloc(d->trans, sizeof(int) * 256 * states_num);
+  d->accept = realloc(d->accept, states_num);
+
+  free(sets);
+  free(next);
+  free(stack);
+  free(n.states);
+
+  return d;
+}
+
+static mpc_parser_t *mpc_dfa(mpc_dfa_t *d, mpc_parser_t *x) {
+  mpc_parser_t *p = mpc_undefined();
+  p->type = MPC_TYPE_DFA;
+  p->data.dfa.d = d;
+  p->data.dfa.x = x;
+  return p;
+}
+
 mpc_parser_t *mpc_re(const char *re) {
   return mpc_re_mode(re, MPC_RE_DEFAULT);
 }
@@ -2360,6 +3093,7 @@ mpc_parser_t *mpc_re_mode(const char *re, int mode) {
   mpc_parser_t *err_out;
   mpc_result_t r;
   mpc_parser_t *Regex, *Term, *Factor, *Base, *Range, *RegexEnclose;
+  mpc_dfa_t *dfa;
 
   Regex  = mpc_new("regex");
   Term   = mpc_new("term");
@@ -2411,13 +3145,16 @@ mpc_parser_t *mpc_re_mode(const char *re, int mode) {
     mpc_err_delete(r.error);
     free(err_msg);
     r.output = err_out;
+    dfa = NULL;
+  } else {
+    dfa = mpc_dfa_compile(re, mode);
   }
 
   mpc_cleanup(6, RegexEnclose, Regex, Term, Factor, Base, Range);
 
   mpc_optimise(r.output);
 
-  return r.output;
+  return dfa ? mpc_dfa(dfa, r.output) : r.output;
 
 }
 
@@ -2805,6 +3542,9 @@ static void mpc_print_unretained(mpc_parser_t *p, int force) {
     mpc_print_unretained(p->data.check_with.x, 0);
     printf("->?");
   }
+  if (p->type == MPC_TYPE_DFA) {
+    mpc_print_unretained(p->data.dfa.x, 0);
+  }
 
 }
 
@@ -2889,6 +3629,11 @@ void mpc_ast_delete(mpc_ast_t *a) {
 
   if (a == NULL) { return; }
 
+  if (a->arena) {
+    if (a->arena->root == a) { mpc_ast_arena_delete(a->arena); }
+    return;
+  }
+
   for (i = 0; i < a->children_num; i++) {
     mpc_ast_delete(a->children[i]);
   }
@@ -2901,6 +3646,7 @@ void mpc_ast_delete(mpc_ast_t *a) {
 }
 
 static void mpc_ast_delete_no_children(mpc_ast_t *a) {
+  if (a->arena) { return; }
   free(a->children);
   free(a->tag);
   free(a->contents);
@@ -2909,18 +3655,24 @@ static void mpc_ast_delete_no_children(mpc_ast_t *a) {
 
 mpc_ast_t *mpc_ast_new(const char *tag, const char *contents) {
 
-  mpc_ast_t *a = malloc(sizeof(mpc_ast_t));
+  mpc_ast_arena_t *arena = mpc_ast_arena_curr;
+  mpc_ast_t *a = mpc_ast_malloc(arena, sizeof(mpc_ast_t));
+  size_t tl = strlen(tag) + 1;
+  size_t cl = strlen(contents) + 1;
 
-  a->tag = malloc(strlen(tag) + 1);
-  strcpy(a->tag, tag);
+  a->arena = arena;
 
-  a->contents = malloc(strlen(contents) + 1);
-  strcpy(a->contents, contents);
+  a->tag = mpc_ast_malloc(arena, tl);
+  memcpy(a->tag, tag, tl);
+
+  a->contents = mpc_ast_malloc(arena, cl);
+  memcpy(a->contents, contents, cl);
 
   a->state = mpc_state_new();
 
   a->children_num = 0;
   a->children = NULL;
+  a->rule = 0;
   return a;
 
 }
@@ -2950,6 +3702,7 @@ mpc_ast_t *mpc_ast_add_root(mpc_ast_t *a) {
   if (a == NULL) { return a; }
   if (a->children_num == 0) { return a; }
   if (a->children_num == 1) { return a; }
+  if (a->rule) { return a; }
 
   r = mpc_ast_new(">", "");
   mpc_ast_add_child(r, a);
@@ -2972,15 +3725,32 @@ int mpc_ast_eq(mpc_ast_t *a, mpc_ast_t *b) {
 }
 
 mpc_ast_t *mpc_ast_add_child(mpc_ast_t *r, mpc_ast_t *a) {
+
+  int n = r->children_num;
+
+  /*
+  ** Arena nodes keep a power of two capacity (at least
+  ** four) implicitly, so the array only moves when a
+  ** child is added to a full one.
+  */
+  if (r->arena) {
+    if (n == 0 || (n >= MPC_AST_CHILDREN_MIN && (n & (n - 1)) == 0)) {
+      r->children = mpc_ast_realloc(r->arena, r->children,
+        sizeof(mpc_ast_t*) * n,
+        sizeof(mpc_ast_t*) * (n == 0 ? MPC_AST_CHILDREN_MIN : n * 2));
+    }
+  } else {
+    r->children = realloc(r->children, sizeof(mpc_ast_t*) * (n + 1));
+  }
+
   r->children_num++;
-  r->children = realloc(r->children, sizeof(mpc_ast_t*) * r->children_num);
   r->children[r->children_num-1] = a;
   return r;
 }
 
 mpc_ast_t *mpc_ast_add_tag(mpc_ast_t *a, const char *t) {
   if (a == NULL) { return a; }
-  a->tag = realloc(a->tag, strlen(t) + 1 + strlen(a->tag) + 1);
+  a->tag = mpc_ast_realloc(a->arena, a->tag, strlen(a->tag) + 1, strlen(t) + 1 + strlen(a->tag) + 1);
   memmove(a->tag + strlen(t) + 1, a->tag, strlen(a->tag)+1);
   memmove(a->tag, t, strlen(t));
   memmove(a->tag + strlen(t), "|", 1);
@@ -2989,14 +3759,14 @@ mpc_ast_t *mpc_ast_add_tag(mpc_ast_t *a, const char *t) {
 
 mpc_ast_t *mpc_ast_add_root_tag(mpc_ast_t *a, const char *t) {
   if (a == NULL) { return a; }
-  a->tag = realloc(a->tag, (strlen(t)-1) + strlen(a->tag) + 1);
+  a->tag = mpc_ast_realloc(a->arena, a->tag, strlen(a->tag) + 1, (strlen(t)-1) + strlen(a->tag) + 1);
   memmove(a->tag + (strlen(t)-1), a->tag, strlen(a->tag)+1);
   memmove(a->tag, t, (strlen(t)-1));
   return a;
 }
 
 mpc_ast_t *mpc_ast_tag(mpc_ast_t *a, const char *t) {
-  a->tag = realloc(a->tag, strlen(t) + 1);
+  a->tag = mpc_ast_realloc(a->arena, a->tag, strlen(a->tag) + 1, strlen(t) + 1);
   strcpy(a->tag, t);
   return a;
 }
@@ -3007,6 +3777,12 @@ mpc_ast_t *mpc_ast_state(mpc_ast_t *a, mpc_state_t s) {
   return a;
 }
 
+mpc_ast_t *mpc_ast_rule(mpc_ast_t *a, int id) {
+  if (a == NULL) { return a; }
+  if (a->rule == 0) { a->rule = id; }
+  return a;
+}
+
 static void mpc_ast_print_depth(mpc_ast_t *a, int d, FILE *fp) {
 
   int i;
@@ -3226,7 +4002,7 @@ mpc_val_t *mpcf_fold_ast(int n, mpc_val_t **xs) {
 
     if (as[i] == NULL) { continue; }
 
-    if        (as[i] && as[i]->children_num == 0) {
+    if        (as[i] && (as[i]->children_num == 0 || as[i]->rule)) {
       mpc_ast_add_child(r, as[i]);
     } else if (as[i] && as[i]->children_num == 1) {
       mpc_ast_add_child(r, mpc_ast_add_root_tag(as[i]->children[0], as[i]->tag));
@@ -3415,11 +4191,30 @@ static mpc_val_t *mpcaf_grammar_repeat(int n, mpc_val_t **xs) {
   return mpca_count(num, xs[0]);
 }
 
+/*
+** With `MPCA_LANG_DROP_LITERALS` string and character
+** literals, and regular expressions that match without
+** consuming anything (such as `/^/` and `/$/`), are
+** matched but never turned into AST nodes. This is best
+** combined with rule ids, as a rule left with a single
+** child would otherwise be merged into its parent.
+*/
+
+static mpc_val_t *mpcaf_drop_empty(mpc_val_t *x) {
+  mpc_ast_t *a = x;
+  if (a->contents[0] == '\0' && a->children_num == 0) {
+    mpc_ast_delete(a);
+    return NULL;
+  }
+  return a;
+}
+
 static mpc_val_t *mpcaf_grammar_string(mpc_val_t *x, void *s) {
   mpca_grammar_st_t *st = s;
   char *y = mpcf_unescape(x);
   mpc_parser_t *p = (st->flags & MPCA_LANG_WHITESPACE_SENSITIVE) ? mpc_string(y) : mpc_tok(mpc_string(y));
   free(y);
+  if (st->flags & MPCA_LANG_DROP_LITERALS) { return mpc_apply(p, mpcf_free); }
   return mpca_state(mpca_tag(mpc_apply(p, mpcf_str_ast), "string"));
 }
 
@@ -3428,6 +4223,7 @@ static mpc_val_t *mpcaf_grammar_char(mpc_val_t *x, void *s) {
   char *y = mpcf_unescape(x);
   mpc_parser_t *p = (st->flags & MPCA_LANG_WHITESPACE_SENSITIVE) ? mpc_char(y[0]) : mpc_tok(mpc_char(y[0]));
   free(y);
+  if (st->flags & MPCA_LANG_DROP_LITERALS) { return mpc_apply(p, mpcf_free); }
   return mpca_state(mpca_tag(mpc_apply(p, mpcf_str_ast), "char"));
 }
 
@@ -3446,7 +4242,8 @@ static mpc_val_t *mpcaf_fold_regex(int n, mpc_val_t **xs) {
   free(y);
   free(m);
 
-  return mpca_state(mpca_tag(mpc_apply(p, mpcf_str_ast), "regex"));
+  p = mpca_state(mpca_tag(mpc_apply(p, mpcf_str_ast), "regex"));
+  return (st->flags & MPCA_LANG_DROP_LITERALS) ? mpc_apply(p, mpcaf_drop_empty) : p;
 }
 
 /* Should this just use `isdigit` instead? */
@@ -3505,13 +4302,19 @@ static mpc_parser_t *mpca_grammar_find_parser(char *x, mpca_grammar_st_t *st) {
 
 }
 
+static mpc_val_t *mpcaf_ast_rule(mpc_val_t *x, void *id) {
+  return mpc_ast_rule(x, *(int*)id);
+}
+
 static mpc_val_t *mpcaf_grammar_id(mpc_val_t *x, void *s) {
 
   mpca_grammar_st_t *st = s;
   mpc_parser_t *p = mpca_grammar_find_parser(x, st);
   free(x);
 
-  if (p->name) {
+  if (p->name && p->rule) {
+    return mpca_state(mpca_root(mpc_apply_to(mpca_add_tag(p, p->name), mpcaf_ast_rule, &p->rule)));
+  } else if (p->name) {
     return mpca_state(mpca_root(mpca_add_tag(p, p->name)));
   } else {
     return mpca_state(mpca_root(p));
@@ -3858,6 +4661,7 @@ static int mpc_nodecount_unretained(mpc_parser_t* p, int force) {
 
   if (p->type == MPC_TYPE_CHECK)    { return 1 + mpc_nodecount_unretained(p->data.check.x, 0); }
   if (p->type == MPC_TYPE_CHECK_WITH) { return 1 + mpc_nodecount_unretained(p->data.check_with.x, 0); }
+  if (p->type == MPC_TYPE_DFA)        { return 1 + mpc_nodecount_unretained(p->data.dfa.x, 0); }
 
   if (p->type == MPC_TYPE_NOT)   { return 1 + mpc_nodecount_unretained(p->data.not.x, 0); }
   if (p->type == MPC_TYPE_MAYBE) { return 1 + mpc_nodecount_unretained(p->data.not.x, 0); }
@@ -3912,6 +4716,7 @@ static void mpc_optimise_unretained(mpc_parser_t *p, int force) {
   if (p->type == MPC_TYPE_MANY)       { mpc_optimise_unretained(p->data.repeat.x, 0); }
   if (p->type == MPC_TYPE_MANY1)      { mpc_optimise_unretained(p->data.repeat.x, 0); }
   if (p->type == MPC_TYPE_COUNT)      { mpc_optimise_unretained(p->data.repeat.x, 0); }
+  if (p->type == MPC_TYPE_DFA)        { mpc_optimise_unretained(p->data.dfa.x, 0); }
 
   if (p->type == MPC_TYPE_OR) {
     for(i = 0; i < p->data.or.n; i++) {
@@ -90,6 +90,7 @@ typedef int(*mpc_check_with_t)(mpc_val_t**,void*);
 */
 
 mpc_parser_t *mpc_new(const char *name);
+mpc_parser_t *mpc_rule_id(mpc_parser_t *p, int id);
 mpc_parser_t *mpc_copy(mpc_parser_t *a);
 mpc_parser_t *mpc_define(mpc_parser_t *p, mpc_parser_t *a);
 mpc_parser_t *mpc_undefine(mpc_parser_t *p);
@@ -281,12 +282,16 @@ mpc_parser_t *mpc_re_mode(const char *re, int mode);
 ** AST
 */
 
+typedef struct mpc_ast_arena_t mpc_ast_arena_t;
+
 typedef struct mpc_ast_t {
   char *tag;
   char *contents;
   mpc_state_t state;
   int children_num;
   struct mpc_ast_t** children;
+  mpc_ast_arena_t *arena;
+  int rule;
 } mpc_ast_t;
 
 mpc_ast_t *mpc_ast_new(const char *tag, const char *contents);
@@ -297,6 +302,7 @@ mpc_ast_t *mpc_ast_add_tag(mpc_ast_t *a, const char *t);
 mpc_ast_t *mpc_ast_add_root_tag(mpc_ast_t *a, const char *t);
 mpc_ast_t *mpc_ast_tag(mpc_ast_t *a, const char *t);
 mpc_ast_t *mpc_ast_state(mpc_ast_t *a, mpc_state_t s);
+mpc_ast_t *mpc_ast_rule(mpc_ast_t *a, int id);
 
 void mpc_ast_delete(mpc_ast_t *a);
 void mpc_ast_print(mpc_ast_t *a);
@@ -354,7 +360,8 @@ mpc_parser_t *mpca_and(int n, ...);
 enum {
   MPCA_LANG_DEFAULT              = 0,
   MPCA_LANG_PREDICTIVE           = 1,
-  MPCA_LANG_WHITESPACE_SENSITIVE = 2
+  MPCA_LANG_WHITESPACE_SENSITIVE = 2,
+  MPCA_LANG_DROP_LITERALS        = 4
 };
 
 mpc_parser_t *mpca_grammar(int flags, const char *grammar, ...);
@@ -0,0 +1,660 @@
+#include "lval.h"
+#include "lenv.h"
+#include "omap.h"
+#include "ordering.h"
+#include "expressions.h"
+#include "common.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+lval* lval_omap(void)
+{
+	lval* v = lval_new(LVAL_OMAP);
+	v->omap = calloc(1, sizeof(lomap));
+	return v;
+}
+
+/*
+ * Nodes
+ */
+
+static onode* node_new(int leaf)
+{
+	onode* n = malloc(sizeof(onode));
+	n->refs = 1;
+	n->count = 0;
+	n->leaf = leaf;
+	return n;
+}
+
+static void node_release(onode* n)
+{
+	if (--n->refs > 0)
+	{
+		return;
+	}
+
+	for (int i = 0; i < n->count; i++)
+	{
+		lval_del(n->keys[i]);
+		lval_del(n->vals[i]);
+	}
+	if (!n->leaf)
+	{
+		for (int i = 0; i <= n->count; i++) { node_release(n->kids[i]); }
+	}
+	free(n);
+}
+
+// a node the caller can change, n is given up
+static onode* node_own(onode* n)
+{
+	if (n->refs == 1)
+	{
+		return n;
+	}
+
+	onode* x = malloc(sizeof(onode));
+	memcpy(x, n, sizeof(onode));
+	x->refs = 1;
+
+	for (int i = 0; i < n->count; i++)
+	{
+		lval_ref(x->keys[i]);
+		lval_ref(x->vals[i]);
+	}
+	if (!n->leaf)
+	{
+		for (int i = 0; i <= n->count; i++) { x->kids[i]->refs++; }
+	}
+
+	n->refs--;
+	return x;
+}
+
+// index of the first key of n that is not below k
+static int node_search(onode* n, lval* k)
+{
+	int lo = 0;
+	int hi = n->count;
+	while (lo < hi)
+	{
+		int mid = (lo + hi) / 2;
+		if (lval_cmp(n->keys[mid], k) < 0) { lo = mid + 1; } else { hi = mid; }
+	}
+	return lo;
+}
+
+static void keys_shift(onode* n, int from, int by)
+{
+	memmove(&n->keys[from + by], &n->keys[from], sizeof(lval*) * (n->count - from));
+	memmove(&n->vals[from + by], &n->vals[from], sizeof(lval*) * (n->count - from));
+}
+
+static void kids_shift(onode* n, int from, int by)
+{
+	memmove(&n->kids[from + by], &n->kids[from], sizeof(onode*) * (n->count + 1 - from));
+}
+
+// splits the full kid i of n in two, its middle key moves up into n
+static void node_split(onode* n, int i)
+{
+	int t = OMAP_DEGREE;
+	onode* c = n->kids[i];
+	onode* z = node_new(c->leaf);
+
+	z->count = t - 1;
+	memcpy(z->keys, &c->keys[t], sizeof(lval*) * (t - 1));
+	memcpy(z->vals, &c->vals[t], sizeof(lval*) * (t - 1));
+	if (!c->leaf)
+	{
+		memcpy(z->kids, &c->kids[t], sizeof(onode*) * t);
+	}
+	c->count = t - 1;
+
+	kids_shift(n, i + 1, 1);
+	keys_shift(n, i, 1);
+	n->kids[i + 1] = z;
+	n->keys[i] = c->keys[t - 1];
+	n->vals[i] = c->vals[t - 1];
+	n->count++;
+}
+
+/*
+ * Insertion splits full nodes on the way down, so there is
+ * always room for the key that moves up.
+ */
+static int node_put(onode* n, lval* k, lval* v)
+{
+	while (1)
+	{
+		int i = node_search(n, k);
+		if (i < n->count && lval_cmp(n->keys[i], k) == 0)
+		{
+			lval_del(n->vals[i]);
+			n->vals[i] = v;
+			lval_del(k);
+			return 0;
+		}
+
+		if (n->leaf)
+		{
+			keys_shift(n, i, 1);
+			n->keys[i] = k;
+			n->vals[i] = v;
+			n->count++;
+			return 1;
+		}
+
+		n->kids[i] = node_own(n->kids[i]);
+		if (n->kids[i]->count == OMAP_MAX_KEYS)
+		{
+			node_split(n, i);
+
+			int c = lval_cmp(k, n->keys[i]);
+			if (c == 0) { continue; }
+			if (c > 0) { i++; }
+		}
+		n = n->kids[i];
+	}
+}
+
+// the last key of kid i-1 moves up into n, and key i-1 of n down into kid i
+static void rotate_right(onode* n, int i)
+{
+	onode* c = n->kids[i];
+	onode* l = n->kids[i - 1] = node_own(n->kids[i - 1]);
+
+	if (!c->leaf)
+	{
+		kids_shift(c, 0, 1);
+		c->kids[0] = l->kids[l->count];
+	}
+	keys_shift(c, 0, 1);
+	c->keys[0] = n->keys[i - 1];
+	c->vals[0] = n->vals[i - 1];
+	c->count++;
+
+	n->keys[i - 1] = l->keys[l->count - 1];
+	n->vals[i - 1] = l->vals[l->count - 1];
+	l->count--;
+}
+
+// the first key of kid i+1 moves up into n, and key i of n down into kid i
+static void rotate_left(onode* n, int i)
+{
+	onode* c = n->kids[i];
+	onode* r = n->kids[i + 1] = node_own(n->kids[i + 1]);
+
+	c->keys[c->count] = n->keys[i];
+	c->vals[c->count] = n->vals[i];
+	if (!c->leaf)
+	{
+		c->kids[c->count + 1] = r->kids[0];
+	}
+	c->count++;
+
+	n->keys[i] = r->keys[0];
+	n->vals[i] = r->vals[0];
+	keys_shift(r, 1, -1);
+	if (!r->leaf)
+	{
+		kids_shift(r, 1, -1);
+	}
+	r->count--;
+}
+
+// key i of n and kid i+1 are appended to kid i
+static void node_merge(onode* n, int i)
+{
+	onode* c = n->kids[i];
+	onode* r = node_own(n->kids[i + 1]);
+
+	c->keys[c->count] = n->keys[i];
+	c->vals[c->count] = n->vals[i];
+	memcpy(&c->keys[c->count + 1], r->keys, sizeof(lval*) * r->count);
+	memcpy(&c->vals[c->count + 1], r->vals, sizeof(lval*) * r->count);
+	if (!c->leaf)
+	{
+		memcpy(&c->kids[c->count + 1], r->kids, sizeof(onode*) * (r->count + 1));
+	}
+	c->count += r->count + 1;
+
+	// everything r held belongs to c now
+	free(r);
+
+	keys_shift(n, i + 1, -1);
+	kids_shift(n, i + 2, -1);
+	n->count--;
+}
+
+/*
+ * Removal makes sure every node it goes down into has a
+ * key to spare, by borrowing from a sibling or merging
+ * with one. k has to be in the tree.
+ */
+static void node_remove(onode* n, lval* k)
+{
+	while (1)
+	{
+		int i = node_search(n, k);
+		int found = i < n->count && lval_cmp(n->keys[i], k) == 0;
+
+		if (n->leaf)
+		{
+			lval_del(n->keys[i]);
+			lval_del(n->vals[i]);
+			keys_shift(n, i + 1, -1);
+			n->count--;
+			return;
+		}
+
+		if (found)
+		{
+			n->kids[i] = node_own(n->kids[i]);
+			n->kids[i + 1] = node_own(n->kids[i + 1]);
+
+			// the key just before or after k takes its place, and is removed below instead
+			onode* p = NULL;
+			int side = n->kids[i]->count >= OMAP_DEGREE ? i : n->kids[i + 1]->count >= OMAP_DEGREE ? i + 1 : -1;
+			if (side == -1)
+			{
+				node_merge(n, i);
+				n = n->kids[i];
+				continue;
+			}
+
+			for (p = n->kids[side]; !p->leaf; p = p->kids[side == i ? p->count : 0]) {}
+			int j = side == i ? p->count - 1 : 0;
+
+			lval_del(n->keys[i]);
+			lval_del(n->vals[i]);
+			n->keys[i] = lval_ref(p->keys[j]);
+			n->vals[i] = lval_ref(p->vals[j]);
+
+			k = n->keys[i];
+			n = n->kids[side];
+			continue;
+		}
+
+		n->kids[i] = node_own(n->kids[i]);
+		if (n->kids[i]->count < OMAP_DEGREE)
+		{
+			if (i > 0 && n->kids[i - 1]->count >= OMAP_DEGREE)
+			{
+				rotate_right(n, i);
+			} else if (i < n->count && n->kids[i + 1]->count >= OMAP_DEGREE) {
+				rotate_left(n, i);
+			} else if (i < n->count) {
+				node_merge(n, i);
+			} else {
+				n->kids[i - 1] = node_own(n->kids[i - 1]);
+				node_merge(n, --i);
+			}
+		}
+		n = n->kids[i];
+	}
+}
+
+/*
+ * Maps
+ */
+
+// a second map with the same entries, the nodes are shared
+lomap* lomap_share(lomap* o)
+{
+	lomap* x = calloc(1, sizeof(lomap));
+	x->count = o->count;
+	x->root = o->root;
+	if (x->root) { x->root->refs++; }
+	return x;
+}
+
+void lomap_del(lomap* o)
+{
+	if (o->root) { node_release(o->root); }
+	free(o);
+}
+
+int lomap_key_ok(lval* k)
+{
+	return k->type == LVAL_NUM || k->type == LVAL_STR;
+}
+
+// the value stored under k, still owned by the map, NULL if there is none
+lval* lomap_get(lomap* o, lval* k)
+{
+	onode* n = o->root;
+	while (n)
+	{
+		int i = node_search(n, k);
+		if (i < n->count && lval_cmp(n->keys[i], k) == 0)
+		{
+			return n->vals[i];
+		}
+		n = n->leaf ? NULL : n->kids[i];
+	}
+	return NULL;
+}
+
+// takes k and v over
+void lomap_put(lomap* o, lval* k, lval* v)
+{
+	if (!o->root) { o->root = node_new(1); }
+	o->root = node_own(o->root);
+
+	// a full root is split, which is the only way the tree grows
+	if (o->root->count == OMAP_MAX_KEYS)
+	{
+		onode* s = node_new(0);
+		s->kids[0] = o->root;
+		node_split(s, 0);
+		o->root = s;
+	}
+
+	o->count += node_put(o->root, k, v);
+}
+
+int lomap_remove(lomap* o, lval* k)
+{
+	if (!lomap_get(o, k)) { return 0; }
+
+	o->root = node_own(o->root);
+	node_remove(o->root, k);
+	o->count--;
+
+	// an empty root hands over to its only kid, which is the only way the tree shrinks
+	if (o->root->count == 0)
+	{
+		onode* r = o->root;
+		o->root = r->leaf ? NULL : r->kids[0];
+		free(r);
+	}
+	return 1;
+}
+
+// nearest entry at or below k, or at or above it with ceil set
+static int lomap_bound(lomap* o, lval* k, int ceil, lval** key, lval** val)
+{
+	int found = 0;
+	onode* n = o->root;
+	while (n)
+	{
+		int i = node_search(n, k);
+		if (i < n->count && lval_cmp(n->keys[i], k) == 0)
+		{
+			*key = n->keys[i];
+			*val = n->vals[i];
+			return 1;
+		}
+
+		// entries further down lie closer to k
+		int j = ceil ? i : i - 1;
+		if (j >= 0 && j < n->count)
+		{
+			*key = n->keys[j];
+			*val = n->vals[j];
+			found = 1;
+		}
+		n = n->leaf ? NULL : n->kids[i];
+	}
+	return found;
+}
+
+static lval* omap_pair(lval* k, lval* v)
+{
+	return lval_add(lval_add(lval_qexpr(), lval_ref(k)), lval_ref(v));
+}
+
+// adds {key value} for lo <= key < hi to out, 0 once hi is reached
+static int node_range(onode* n, lval* lo, lval* hi, lval* out)
+{
+	for (int i = node_search(n, lo); i <= n->count; i++)
+	{
+		if (!n->leaf && !node_range(n->kids[i], lo, hi, out))
+		{
+			return 0;
+		}
+		if (i == n->count)
+		{
+			break;
+		}
+		if (lval_cmp(n->keys[i], hi) >= 0)
+		{
+			return 0;
+		}
+		lval_add(out, omap_pair(n->keys[i], n->vals[i]));
+	}
+	return 1;
+}
+
+/*
+ * In order iteration. A step of a node walks kid s/2 when
+ * s is even and yields key s/2 when it is odd, leaves only
+ * have keys.
+ */
+
+void omap_iter_init(omap_iter* it, lomap* o)
+{
+	it->depth = 0;
+	if (o->root)
+	{
+		it->nodes[0] = o->root;
+		it->next[0] = 0;
+		it->depth = 1;
+	}
+}
+
+// borrowed key and val of the next entry, 0 after the last one
+int omap_iter_next(omap_iter* it, lval** key, lval** val)
+{
+	while (it->depth)
+	{
+		onode* n = it->nodes[it->depth - 1];
+		int s = it->next[it->depth - 1]++;
+		int i = n->leaf ? s : s / 2;
+
+		if (n->leaf ? s >= n->count : s > 2 * n->count)
+		{
+			it->depth--;
+			continue;
+		}
+
+		if (!n->leaf && s % 2 == 0)
+		{
+			it->nodes[it->depth] = n->kids[i];
+			it->next[it->depth] = 0;
+			it->depth++;
+			continue;
+		}
+
+		*key = n->keys[i];
+		*val = n->vals[i];
+		return 1;
+	}
+	return 0;
+}
+
+/*
+ * Builtins
+ */
+
+#define LASSERT_KEY(func, args, index) \
+	LASSERT(args, lomap_key_ok(args->cell[index]), \
+		"Function '%s' passed a %s key, ordered keys are numbers or strings.", \
+		func, ltype_name(args->cell[index]->type))
+
+// (omap-new {{key value} ...})
+lval* builtin_omap_new(__attribute__((unused)) lenv* e, lval* a)
+{
+	LASSERT_NUM("omap-new", a, 1);
+	LASSERT_TYPE("omap-new", a, 0, LVAL_QEXPR);
+
+	lval* pairs = a->cell[0];
+	for (int i = 0; i < pairs->count; i++)
+	{
+		lval* p = pairs->cell[i];
+		LASSERT(a, p->type == LVAL_QEXPR && p->count == 2,
+			"Function 'omap-new' expected {key value} pairs, element %i is not one.", i);
+		LASSERT(a, lomap_key_ok(p->cell[0]),
+			"Function 'omap-new' passed a %s key at %i, ordered keys are numbers or strings.",
+			ltype_name(p->cell[0]->type), i);
+	}
+
+	lval* x = lval_omap();
+	for (int i = 0; i < pairs->count; i++)
+	{
+		lval* p = pairs->cell[i];
+		lomap_put(x->omap, lval_ref(p->cell[0]), lval_ref(p->cell[1]));
+	}
+
+	lval_del(a);
+	return x;
+}
+
+// (omap-get map key) or (omap-get map key default)
+lval* builtin_omap_get(__attribute__((unused)) lenv* e, lval* a)
+{
+	LASSERT(a, a->count == 2 || a->count == 3,
+		"Function 'omap-get' passed incorrect number of arguments. "
+		"Got %i, Expected 2 or 3.", a->count);
+	LASSERT_TYPE("omap-get", a, 0, LVAL_OMAP);
+	LASSERT_KEY("omap-get", a, 1);
+
+	lval* v = lomap_get(a->cell[0]->omap, a->cell[1]);
+	if (!v)
+	{
+		LASSERT(a, a->count == 3, "Function 'omap-get' passed a key that is not in the map.");
+		return lval_take(a, 2);
+	}
+
+	v = lval_ref(v);
+	lval_del(a);
+	return v;
+}
+
+// (omap-put map key value)
+lval* builtin_omap_put(__attribute__((unused)) lenv* e, lval* a)
+{
+	LASSERT_NUM("omap-put", a, 3);
+	LASSERT_TYPE("omap-put", a, 0, LVAL_OMAP);
+	LASSERT_KEY("omap-put", a, 1);
+
+	lval* o = lval_own(lval_pop(a, 0));
+	lval* key = lval_pop(a, 0);
+	lval* val = lval_pop(a, 0);
+
+	lomap_put(o->omap, key, val);
+	o->hash = 0;
+
+	lval_del(a);
+	return o;
+}
+
+// (omap-del map key), a missing key leaves the map as it is
+lval* builtin_omap_del(__attribute__((unused)) lenv* e, lval* a)
+{
+	LASSERT_NUM("omap-del", a, 2);
+	LASSERT_TYPE("omap-del", a, 0, LVAL_OMAP);
+	LASSERT_KEY("omap-del", a, 1);
+
+	lval* o = lval_pop(a, 0);
+	if (lomap_get(o->omap, a->cell[0]))
+	{
+		o = lval_own(o);
+		lomap_remove(o->omap, a->cell[0]);
+		o->hash = 0;
+	}
+
+	lval_del(a);
+	return o;
+}
+
+// (omap-range map lo hi) gives {{key value} ...} for lo <= key < hi, in order
+lval* builtin_omap_range(__attribute__((unused)) lenv* e, lval* a)
+{
+	LASSERT_NUM("omap-range", a, 3);
+	LASSERT_TYPE("omap-range", a, 0, LVAL_OMAP);
+	LASSERT_KEY("omap-range", a, 1);
+	LASSERT_KEY("omap-range", a, 2);
+
+	lval* x = lval_qexpr();
+	if (a->cell[0]->omap->root)
+	{
+		node_range(a->cell[0]->omap->root, a->cell[1], a->cell[2], x);
+	}
+
+	lval_del(a);
+	return x;
+}
+
+static lval* omap_bound(lval* a, char* func, int ceil)
+{
+	LASSERT_NUM(func, a, 2);
+	LASSERT_TYPE(func, a, 0, LVAL_OMAP);
+	LASSERT_KEY(func, a, 1);
+
+	lval* key;
+	lval* val;
+	lval* x = lomap_bound(a->cell[0]->omap, a->cell[1], ceil, &key, &val)
+		? omap_pair(key, val) : lval_qexpr();
+
+	lval_del(a);
+	return x;
+}
+
+// (omap-floor map key) gives {key value} of the greatest key <= key, or {}
+lval* builtin_omap_floor(__attribute__((unused)) lenv* e, lval* a)
+{
+	return omap_bound(a, "omap-floor", 0);
+}
+
+// (omap-ceil map key) gives {key value} of the least key >= key, or {}
+lval* builtin_omap_ceil(__attribute__((unused)) lenv* e, lval* a)
+{
+	return omap_bound(a, "omap-ceil", 1);
+}
+
+static lval* omap_list(lval* a, char* func, int pairs)
+{
+	LASSERT_NUM(func, a, 1);
+	LASSERT_TYPE(func, a, 0, LVAL_OMAP);
+
+	lomap* o = a->cell[0]->omap;
+	lval* x = lval_qexpr();
+	x->cell = malloc(sizeof(lval*) * o->count);
+
+	omap_iter it;
+	omap_iter_init(&it, o);
+	lval* key;
+	lval* val;
+	while (omap_iter_next(&it, &key, &val))
+	{
+		x->cell[x->count++] = pairs ? omap_pair(key, val) : lval_ref(key);
+	}
+
+	lval_del(a);
+	return x;
+}
+
+lval* builtin_omap_keys(__attribute__((unused)) lenv* e, lval* a)
+{
+	return omap_list(a, "omap-keys", 0);
+}
+
+// {{key value} ...} in key order
+lval* builtin_omap_items(__attribute__((unused)) lenv* e, lval* a)
+{
+	return omap_list(a, "omap-items", 1);
+}
+
+lval* builtin_omap_count(__attribute__((unused)) lenv* e, lval* a)
+{
+	LASSERT_NUM("omap-count", a, 1);
+	LASSERT_TYPE("omap-count", a, 0, LVAL_OMAP);
+
+	lval* x = lval_num(a->cell[0]->omap->count);
+	lval_del(a);
+	return x;
+}
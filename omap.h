@@ -0,0 +1,66 @@
+#ifndef OMAP_H
+#define OMAP_H
+
+typedef struct lval lval;
+typedef struct lenv lenv;
+
+/*
+ * Ordered maps, as B-trees. Keys are numbers or strings,
+ * ordered by lval_cmp: numbers by value, strings byte by
+ * byte, every number before every string. A node holds up
+ * to OMAP_MAX_KEYS keys side by side and is searched by
+ * bisection, every node but the root at least half full.
+ *
+ * Nodes are counted and copied on change like HAMT nodes
+ * (see hamt.h), so versions of a map share what they can.
+ */
+#define OMAP_DEGREE 16
+#define OMAP_MAX_KEYS (2 * OMAP_DEGREE - 1)
+#define OMAP_MAX_DEPTH 16
+
+typedef struct onode
+{
+	int refs;
+	int count;
+	int leaf;
+	lval* keys[OMAP_MAX_KEYS];
+	lval* vals[OMAP_MAX_KEYS];
+	struct onode* kids[OMAP_MAX_KEYS + 1];
+} onode;
+
+typedef struct lomap
+{
+	int count;
+	onode* root;
+} lomap;
+
+typedef struct omap_iter
+{
+	int depth;
+	onode* nodes[OMAP_MAX_DEPTH];
+	int next[OMAP_MAX_DEPTH];
+} omap_iter;
+
+lval* lval_omap(void);
+lomap* lomap_share(lomap*);
+void lomap_del(lomap*);
+int lomap_key_ok(lval*);
+lval* lomap_get(lomap*, lval*);
+void lomap_put(lomap*, lval*, lval*);
+int lomap_remove(lomap*, lval*);
+
+void omap_iter_init(omap_iter*, lomap*);
+int omap_iter_next(omap_iter*, lval**, lval**);
+
+lval* builtin_omap_new(lenv*, lval*);
+lval* builtin_omap_get(lenv*, lval*);
+lval* builtin_omap_put(lenv*, lval*);
+lval* builtin_omap_del(lenv*, lval*);
+lval* builtin_omap_range(lenv*, lval*);
+lval* builtin_omap_floor(lenv*, lval*);
+lval* builtin_omap_ceil(lenv*, lval*);
+lval* builtin_omap_keys(lenv*, lval*);
+lval* builtin_omap_items(lenv*, lval*);
+lval* builtin_omap_count(lenv*, lval*);
+
+#endif
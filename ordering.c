@@ -3,14 +3,17 @@
 #include "expressions.h"
 #include <string.h>
 #include "ordering.h"
+#include "rope.h"
 #include <stdio.h>
 #include "common.h"
 
 lval* builtin_ordering_op(__attribute__((unused)) lenv* e, lval*a, char* op)
 {
-	
-	// ensure every argument is a number
-	for (int i = 0; i < a->count; i++)
+	LASSERT(a, a->count > 0, "Function '%s' passed no arguments.", op);
+
+	// equality works on any type, the orderings only on numbers
+	int eq = strcmp(op, "==") == 0;
+	for (int i = 0; i < a->count && !eq; i++)
 	{
 		if (a->cell[i]->type != LVAL_NUM)
 		{
@@ -19,35 +22,46 @@ lval* builtin_ordering_op(__attribute__((unused)) lenv* e, lval*a, char* op)
 		}
 	}
 
-	lval* x = lval_pop(a, 0);
-	lval* ret = lval_bool(TRUE);
+	int state = TRUE;
 
-	while(a->count > 0)
+	for (int i = 1; i < a->count && state; i++)
 	{
-		lval* y = lval_pop(a, 0);
+		lval* x = a->cell[i-1];
+		lval* y = a->cell[i];
 
 		if (strcmp(op, "<") == 0) { 
-			ret->bool_state = (x->num < y->num) ? TRUE : FALSE;
+			state = x->num < y->num;
 		} else if (strcmp(op, ">") == 0) { 
-			ret->bool_state = (x->num > y->num) ? TRUE : FALSE;
+			state = x->num > y->num;
 		} else if (strcmp(op, "<=") == 0) { 
-			ret->bool_state = (x->num <= y->num) ? TRUE : FALSE;
+			state = x->num <= y->num;
 		} else if (strcmp(op, ">=") == 0) { 
-			ret->bool_state = (x->num >= y->num) ? TRUE : FALSE;
-		} else if (strcmp(op, "==") == 0) { 
-			ret->bool_state = lval_eq(x, y);
-		}
-
-		if ( ret->bool_state == FALSE) {
-			lval_del(a);
-			lval_del(y);
-			return lval_bool(FALSE);
+			state = x->num >= y->num;
+		} else if (eq) { 
+			state = lval_eq(x, y);
 		}
-		lval_del(x);
-		x = y;
 	}
+
 	lval_del(a);
-	return lval_bool(TRUE);
+	return lval_bool(state);
+}
+
+/*
+ * Order of keys in sorted containers, for numbers and
+ * strings only: numbers by value, strings byte by byte,
+ * and every number before every string.
+ */
+int lval_cmp(lval* x, lval* y)
+{
+	if (x->type != y->type)
+	{
+		return x->type == LVAL_NUM ? -1 : 1;
+	}
+	if (x->type == LVAL_NUM)
+	{
+		return (x->num > y->num) - (x->num < y->num);
+	}
+	return rope_cmp(x, y);
 }
 
 lval* builtin_lt(lenv* e, lval* a)
@@ -1,6 +1,7 @@
 #ifndef ORDERING_H
 #define ORDERING_H
 lval* builtin_ordering_op(lenv* e, lval*a, char* op);
+int lval_cmp(lval* x, lval* y);
 lval* builtin_lt(lenv* e, lval* a);
 lval* builtin_gt(lenv* e, lval* a);
 lval* builtin_lte(lenv* e, lval* a);
@@ -0,0 +1,248 @@
+#include "lval.h"
+#include "lenv.h"
+#include "pqueue.h"
+#include "expressions.h"
+#include "common.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+lval* lval_pqueue(void)
+{
+	lval* v = lval_new(LVAL_PQUEUE);
+	v->pqueue = calloc(1, sizeof(lpqueue));
+	return v;
+}
+
+// copy gives each value to the new queue, lval_ref or lval_copy
+lpqueue* lpqueue_copy(lpqueue* q, lval*(*copy)(lval*))
+{
+	lpqueue* x = calloc(1, sizeof(lpqueue));
+	if (q->count == 0) { return x; }
+
+	x->count = x->cap = q->count;
+	x->entries = malloc(sizeof(pq_entry) * q->count);
+	for (int i = 0; i < q->count; i++)
+	{
+		x->entries[i].prio = q->entries[i].prio;
+		x->entries[i].val = copy(q->entries[i].val);
+	}
+	return x;
+}
+
+void lpqueue_del(lpqueue* q)
+{
+	for (int i = 0; i < q->count; i++)
+	{
+		lval_del(q->entries[i].val);
+	}
+	free(q->entries);
+	free(q);
+}
+
+static void sift_up(lpqueue* q, int i)
+{
+	pq_entry x = q->entries[i];
+	while (i > 0)
+	{
+		int parent = (i - 1) / PQ_ARITY;
+		if (q->entries[parent].prio <= x.prio) { break; }
+		q->entries[i] = q->entries[parent];
+		i = parent;
+	}
+	q->entries[i] = x;
+}
+
+static void sift_down(lpqueue* q, int i)
+{
+	pq_entry x = q->entries[i];
+	while (1)
+	{
+		int first = PQ_ARITY * i + 1;
+		if (first >= q->count) { break; }
+
+		int last = first + PQ_ARITY < q->count ? first + PQ_ARITY : q->count;
+		int min = first;
+		for (int c = first + 1; c < last; c++)
+		{
+			if (q->entries[c].prio < q->entries[min].prio) { min = c; }
+		}
+
+		if (q->entries[min].prio >= x.prio) { break; }
+		q->entries[i] = q->entries[min];
+		i = min;
+	}
+	q->entries[i] = x;
+}
+
+// takes val over
+void lpqueue_push(lpqueue* q, long prio, lval* val)
+{
+	if (q->count == q->cap)
+	{
+		q->cap = q->cap ? q->cap * 2 : 8;
+		q->entries = realloc(q->entries, sizeof(pq_entry) * q->cap);
+	}
+
+	q->entries[q->count] = (pq_entry) { prio, val };
+	sift_up(q, q->count++);
+}
+
+// the entry with the lowest priority moves out of the heap, to entries[count]
+static void lpqueue_pop(lpqueue* q)
+{
+	pq_entry top = q->entries[0];
+	q->count--;
+	if (q->count > 0)
+	{
+		q->entries[0] = q->entries[q->count];
+		sift_down(q, 0);
+	}
+	q->entries[q->count] = top;
+}
+
+// restores the heap over entries in any order, bottom up in O(n)
+void lpqueue_heapify(lpqueue* q)
+{
+	if (q->count < 2) { return; }
+
+	for (int i = (q->count - 2) / PQ_ARITY; i >= 0; i--)
+	{
+		sift_down(q, i);
+	}
+}
+
+static int entry_order(const void* x, const void* y)
+{
+	const pq_entry* a = x;
+	const pq_entry* b = y;
+	if (a->prio != b->prio) { return a->prio < b->prio ? -1 : 1; }
+
+	unsigned long long ha = lval_hash(a->val);
+	unsigned long long hb = lval_hash(b->val);
+	return (ha > hb) - (ha < hb);
+}
+
+/*
+ * Queues are equal when they hold the same entries, however
+ * their heaps are laid out. Both are put in order of
+ * priority, ties broken by hash, and compared pairwise.
+ */
+int lpqueue_eq(lpqueue* x, lpqueue* y)
+{
+	if (x->count != y->count)
+	{
+		return 0;
+	}
+
+	pq_entry* a = malloc(sizeof(pq_entry) * x->count);
+	pq_entry* b = malloc(sizeof(pq_entry) * y->count);
+	memcpy(a, x->entries, sizeof(pq_entry) * x->count);
+	memcpy(b, y->entries, sizeof(pq_entry) * y->count);
+	qsort(a, x->count, sizeof(pq_entry), entry_order);
+	qsort(b, y->count, sizeof(pq_entry), entry_order);
+
+	int eq = 1;
+	for (int i = 0; i < x->count && eq; i++)
+	{
+		eq = a[i].prio == b[i].prio && lval_eq(a[i].val, b[i].val);
+	}
+
+	free(a);
+	free(b);
+	return eq;
+}
+
+/*
+ * Builtins
+ */
+
+// (pq-new {{priority value} ...}), heapified in one go
+lval* builtin_pq_new(__attribute__((unused)) lenv* e, lval* a)
+{
+	LASSERT_NUM("pq-new", a, 1);
+	LASSERT_TYPE("pq-new", a, 0, LVAL_QEXPR);
+
+	lval* pairs = a->cell[0];
+	for (int i = 0; i < pairs->count; i++)
+	{
+		lval* p = pairs->cell[i];
+		LASSERT(a, p->type == LVAL_QEXPR && p->count == 2 && p->cell[0]->type == LVAL_NUM,
+			"Function 'pq-new' expected {priority value} pairs with a number "
+			"for the priority, element %i is not one.", i);
+	}
+
+	lval* x = lval_pqueue();
+	lpqueue* q = x->pqueue;
+	q->count = q->cap = pairs->count;
+	q->entries = malloc(sizeof(pq_entry) * pairs->count);
+	for (int i = 0; i < pairs->count; i++)
+	{
+		q->entries[i].prio = pairs->cell[i]->cell[0]->num;
+		q->entries[i].val = lval_ref(pairs->cell[i]->cell[1]);
+	}
+	lpqueue_heapify(q);
+
+	lval_del(a);
+	return x;
+}
+
+// (pq-push queue priority value)
+lval* builtin_pq_push(__attribute__((unused)) lenv* e, lval* a)
+{
+	LASSERT_NUM("pq-push", a, 3);
+	LASSERT_TYPE("pq-push", a, 0, LVAL_PQUEUE);
+	LASSERT_TYPE("pq-push", a, 1, LVAL_NUM);
+
+	lval* q = lval_own(lval_pop(a, 0));
+	long prio = a->cell[0]->num;
+	lval* val = lval_pop(a, 1);
+
+	lpqueue_push(q->pqueue, prio, val);
+	q->hash = 0;
+
+	lval_del(a);
+	return q;
+}
+
+// (pq-peek queue) gives {priority value} of the lowest priority
+lval* builtin_pq_peek(__attribute__((unused)) lenv* e, lval* a)
+{
+	LASSERT_NUM("pq-peek", a, 1);
+	LASSERT_TYPE("pq-peek", a, 0, LVAL_PQUEUE);
+	LASSERT(a, a->cell[0]->pqueue->count != 0, "Function 'pq-peek' passed an empty queue!");
+
+	pq_entry* top = &a->cell[0]->pqueue->entries[0];
+	lval* x = lval_add(lval_qexpr(), lval_num(top->prio));
+	x = lval_add(x, lval_ref(top->val));
+
+	lval_del(a);
+	return x;
+}
+
+// (pq-pop queue) gives {priority value rest}, rest being the queue without them
+lval* builtin_pq_pop(__attribute__((unused)) lenv* e, lval* a)
+{
+	LASSERT_NUM("pq-pop", a, 1);
+	LASSERT_TYPE("pq-pop", a, 0, LVAL_PQUEUE);
+	LASSERT(a, a->cell[0]->pqueue->count != 0, "Function 'pq-pop' passed an empty queue!");
+
+	lval* q = lval_own(lval_take(a, 0));
+	lpqueue_pop(q->pqueue);
+	q->hash = 0;
+
+	pq_entry* top = &q->pqueue->entries[q->pqueue->count];
+	lval* x = lval_add(lval_qexpr(), lval_num(top->prio));
+	x = lval_add(x, top->val);
+	return lval_add(x, q);
+}
+
+lval* builtin_pq_count(__attribute__((unused)) lenv* e, lval* a)
+{
+	LASSERT_NUM("pq-count", a, 1);
+	LASSERT_TYPE("pq-count", a, 0, LVAL_PQUEUE);
+
+	lval* x = lval_num(a->cell[0]->pqueue->count);
+	lval_del(a);
+	return x;
+}
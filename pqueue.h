@@ -0,0 +1,41 @@
+#ifndef PQUEUE_H
+#define PQUEUE_H
+
+typedef struct lval lval;
+typedef struct lenv lenv;
+
+/*
+ * Priority queues, as 4-ary min-heaps in a flat array with
+ * the numeric priority of each entry kept next to it. The
+ * lowest priority comes out first, in no particular order
+ * among equal ones.
+ */
+#define PQ_ARITY 4
+
+typedef struct pq_entry
+{
+	long prio;
+	lval* val;
+} pq_entry;
+
+typedef struct lpqueue
+{
+	int count;
+	int cap;
+	pq_entry* entries;
+} lpqueue;
+
+lval* lval_pqueue(void);
+lpqueue* lpqueue_copy(lpqueue*, lval*(*)(lval*));
+void lpqueue_del(lpqueue*);
+void lpqueue_push(lpqueue*, long, lval*);
+void lpqueue_heapify(lpqueue*);
+int lpqueue_eq(lpqueue*, lpqueue*);
+
+lval* builtin_pq_new(lenv*, lval*);
+lval* builtin_pq_push(lenv*, lval*);
+lval* builtin_pq_pop(lenv*, lval*);
+lval* builtin_pq_peek(lenv*, lval*);
+lval* builtin_pq_count(lenv*, lval*);
+
+#endif
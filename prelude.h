@@ -0,0 +1,13 @@
+#ifndef PRELUDE_H
+#define PRELUDE_H
+
+#include <stddef.h>
+
+/*
+ * Image of the global env after loading prelude.phi,
+ * generated into prelude_data.c by mkprelude at build time.
+ */
+extern const unsigned char prelude_image[];
+extern const size_t prelude_image_len;
+
+#endif
@@ -0,0 +1,344 @@
+#include "lval.h"
+#include "lenv.h"
+#include "print.h"
+#include "memo.h"
+#include "map.h"
+#include "hamt.h"
+#include "omap.h"
+#include "pqueue.h"
+#include "rope.h"
+#include "file.h"
+#include "vec.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+enum
+{
+	// print v
+	TASK_VAL,
+	// print text
+	TASK_TEXT,
+	// print v->cell[i] onwards, spaced, then close
+	TASK_CELLS,
+	// print entries of a map, priority queue or vector from i onwards
+	TASK_ENTRIES,
+	// print what is left of the hamt or omap it iterates over
+	TASK_ITER
+};
+
+typedef struct print_task
+{
+	int kind;
+	lval* v;
+	char* text;
+	int i;
+	int first;
+	char close;
+	// hamt_iter or omap_iter of a TASK_ITER
+	void* it;
+} print_task;
+
+typedef struct print_stack
+{
+	print_task* tasks;
+	int count;
+	int cap;
+} print_stack;
+
+static void push(print_stack* s, print_task t)
+{
+	if (s->count == s->cap)
+	{
+		s->cap = s->cap ? s->cap * 2 : 32;
+		s->tasks = realloc(s->tasks, sizeof(print_task) * s->cap);
+	}
+	s->tasks[s->count++] = t;
+}
+
+static void push_val(print_stack* s, lval* v)
+{
+	push(s, (print_task) { .kind = TASK_VAL, .v = v });
+}
+
+static void push_text(print_stack* s, char* text)
+{
+	push(s, (print_task) { .kind = TASK_TEXT, .text = text });
+}
+
+static void push_cells(print_stack* s, lval* v, int first, char close)
+{
+	push(s, (print_task) { .kind = TASK_CELLS, .v = v, .i = first, .first = first, .close = close });
+}
+
+static void put_text(sbuf* b, char* text)
+{
+	sbuf_put(b, text, strlen(text));
+}
+
+// digits from the right, no printf
+static void put_num(sbuf* b, long n)
+{
+	char digits[24];
+	int i = sizeof(digits);
+	unsigned long u = n < 0 ? 0UL - (unsigned long) n : (unsigned long) n;
+	do
+	{
+		digits[--i] = '0' + u % 10;
+		u /= 10;
+	} while (u);
+	if (n < 0) { digits[--i] = '-'; }
+	sbuf_put(b, digits + i, sizeof(digits) - i);
+}
+
+// the escapes mpcf_unescape reads back
+static const char* escapes[256] =
+{
+	['\a'] = "\\a", ['\b'] = "\\b", ['\f'] = "\\f", ['\n'] = "\\n",
+	['\r'] = "\\r", ['\t'] = "\\t", ['\v'] = "\\v", ['\\'] = "\\\\",
+	['\''] = "\\'", ['"'] = "\\\"", ['\0'] = "\\0"
+};
+
+// runs of bytes that need no escape go in with one copy each
+static void put_str(sbuf* b, lval* v)
+{
+	sbuf_put_u8(b, '"');
+	rope_iter it;
+	rope_iter_init(&it, v);
+	char* s;
+	long n;
+	while (rope_iter_next(&it, &s, &n))
+	{
+		long run = 0;
+		for (long i = 0; i < n; i++)
+		{
+			const char* e = escapes[(unsigned char) s[i]];
+			if (!e) { continue; }
+
+			sbuf_put(b, s + run, i - run);
+			put_text(b, (char*) e);
+			run = i + 1;
+		}
+		sbuf_put(b, s + run, n - run);
+	}
+	sbuf_put_u8(b, '"');
+}
+
+// atoms go straight into b, the parts of anything else onto s
+static void put_val(sbuf* b, print_stack* s, lval* v)
+{
+	switch (v->type)
+	{
+		case LVAL_NUM: put_num(b, v->num); break;
+		case LVAL_BOOL: put_text(b, v->bool_state == TRUE ? "true" : "false"); break;
+
+		// if an error, print message relevant to the error
+		case LVAL_ERR: put_text(b, "Error: "); put_text(b, v->err); break;
+		case LVAL_SYM: put_text(b, v->sym); break;
+		case LVAL_STR: put_str(b, v); break;
+		case LVAL_FILE: put_text(b, "<file "); put_text(b, v->file->path); sbuf_put_u8(b, '>'); break;
+
+		case LVAL_QEXPR: sbuf_put_u8(b, '{'); push_cells(s, v, 0, '}'); break;
+		case LVAL_SEXPR: sbuf_put_u8(b, '('); push_cells(s, v, 0, ')'); break;
+
+		case LVAL_FUN:
+			if (v->builtin)
+			{
+				put_text(b, "<builtin>");
+			} else if (v->memo) {
+				put_text(b, "(memo ");
+				push_text(s, ")");
+				push_val(s, v->memo->fn);
+			} else if (v->fn) {
+				// shown as the lambda over the formals still unbound
+				put_text(b, "(\\ {");
+				push_text(s, ")");
+				push_val(s, v->fn->body);
+				push_text(s, " ");
+				push_cells(s, v->fn->formals, v->count, '}');
+			} else {
+				put_text(b, "(\\ ");
+				push_text(s, ")");
+				push_val(s, v->body);
+				push_text(s, " ");
+				push_val(s, v->formals);
+			}
+		break;
+
+		// printed as the call that builds it
+		case LVAL_MAP:
+			put_text(b, "(map-new {");
+			push(s, (print_task) { .kind = TASK_ENTRIES, .v = v });
+		break;
+		// in heap order, pq-new heapifies them again
+		case LVAL_PQUEUE:
+			put_text(b, "(pq-new {");
+			push(s, (print_task) { .kind = TASK_ENTRIES, .v = v });
+		break;
+		case LVAL_VEC:
+			put_text(b, "(vec-new {");
+			push(s, (print_task) { .kind = TASK_ENTRIES, .v = v });
+		break;
+
+		case LVAL_HAMT:
+		{
+			put_text(b, "(hamt-new {");
+			hamt_iter* it = malloc(sizeof(hamt_iter));
+			hamt_iter_init(it, v->hamt);
+			push(s, (print_task) { .kind = TASK_ITER, .v = v, .it = it });
+		}
+		break;
+		case LVAL_OMAP:
+		{
+			put_text(b, "(omap-new {");
+			omap_iter* it = malloc(sizeof(omap_iter));
+			omap_iter_init(it, v->omap);
+			push(s, (print_task) { .kind = TASK_ITER, .v = v, .it = it });
+		}
+		break;
+	}
+}
+
+// pushes {key val} to print, after a space unless it is the first
+static void put_pair(sbuf* b, print_stack* s, int first, lval* key, lval* val)
+{
+	if (!first) { sbuf_put_u8(b, ' '); }
+	sbuf_put_u8(b, '{');
+	push_text(s, "}");
+	push_val(s, val);
+	push_text(s, " ");
+	push_val(s, key);
+}
+
+// one step of t, which is put back if it is not done yet
+static void run_task(sbuf* b, print_stack* s, print_task t)
+{
+	switch (t.kind)
+	{
+		case TASK_VAL: put_val(b, s, t.v); break;
+		case TASK_TEXT: put_text(b, t.text); break;
+
+		case TASK_CELLS:
+			if (t.i == t.v->count)
+			{
+				sbuf_put_u8(b, t.close);
+				break;
+			}
+			if (t.i != t.first) { sbuf_put_u8(b, ' '); }
+			t.i++;
+			push(s, t);
+			push_val(s, t.v->cell[t.i - 1]);
+		break;
+
+		case TASK_ENTRIES:
+		{
+			if (t.v->type == LVAL_VEC)
+			{
+				// numbers need no tasks of their own, a chunk of them goes at a time
+				lvec* v = t.v->vec;
+				long end = t.i + PRINT_CHUNK / 32 < v->count ? t.i + PRINT_CHUNK / 32 : v->count;
+				for (; t.i < end; t.i++)
+				{
+					if (t.i) { sbuf_put_u8(b, ' '); }
+					put_num(b, v->items[t.i]);
+				}
+				if (t.i == v->count) { put_text(b, "})"); }
+				else { push(s, t); }
+				break;
+			}
+
+			int count = t.v->type == LVAL_MAP ? t.v->map->count : t.v->pqueue->count;
+			if (t.i == count)
+			{
+				put_text(b, "})");
+				break;
+			}
+			t.i++;
+			push(s, t);
+			if (t.v->type == LVAL_MAP)
+			{
+				lmap_entry* e = &t.v->map->entries[t.i - 1];
+				put_pair(b, s, t.i == 1, e->key, e->val);
+			} else {
+				pq_entry* e = &t.v->pqueue->entries[t.i - 1];
+				if (t.i != 1) { sbuf_put_u8(b, ' '); }
+				sbuf_put_u8(b, '{');
+				put_num(b, e->prio);
+				sbuf_put_u8(b, ' ');
+				push_text(s, "}");
+				push_val(s, e->val);
+			}
+		}
+		break;
+
+		case TASK_ITER:
+		{
+			lval* key;
+			lval* val;
+			int more = t.v->type == LVAL_HAMT ?
+				hamt_iter_next(t.it, &key, &val) : omap_iter_next(t.it, &key, &val);
+			if (!more)
+			{
+				free(t.it);
+				put_text(b, "})");
+				break;
+			}
+			t.i++;
+			push(s, t);
+			put_pair(b, s, t.i == 1, key, val);
+		}
+		break;
+	}
+}
+
+void sbuf_flush(sbuf* b, FILE* out)
+{
+	fwrite(b->data, 1, b->len, out);
+	b->len = 0;
+}
+
+// renders v at the end of b, which goes out to out (if any) every PRINT_CHUNK bytes
+void lval_write(sbuf* b, lval* v, FILE* out)
+{
+	print_stack s = { NULL, 0, 0 };
+	push_val(&s, v);
+	while (s.count)
+	{
+		run_task(b, &s, s.tasks[--s.count]);
+		if (out && b->len >= PRINT_CHUNK) { sbuf_flush(b, out); }
+	}
+	free(s.tasks);
+}
+
+void lval_print(lval* v)
+{
+	sbuf b = { NULL, 0, 0 };
+	lval_write(&b, v, stdout);
+	sbuf_flush(&b, stdout);
+	free(b.data);
+}
+
+void lval_println(lval* v)
+{
+	sbuf b = { NULL, 0, 0 };
+	lval_write(&b, v, stdout);
+	sbuf_put_u8(&b, '\n');
+	sbuf_flush(&b, stdout);
+	free(b.data);
+}
+
+// (print-to-string x ...) what print would show, without the newline
+lval* builtin_print_to_string(__attribute__((unused)) lenv* e, lval* a)
+{
+	sbuf b = { NULL, 0, 0 };
+	for (int i = 0; i < a->count; i++)
+	{
+		if (i) { sbuf_put_u8(&b, ' '); }
+		lval_write(&b, a->cell[i], NULL);
+	}
+
+	lval* x = b.len ? lval_strn(b.data, b.len) : lval_str("");
+	free(b.data);
+	lval_del(a);
+	return x;
+}
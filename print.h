@@ -0,0 +1,23 @@
+#ifndef PRINT_H
+#define PRINT_H
+
+#include <stdio.h>
+#include "serialize.h"
+
+typedef struct lval lval;
+typedef struct lenv lenv;
+
+/*
+ * Values are rendered into an sbuf, walking nested ones with
+ * a stack of what is left to print instead of recursing, so
+ * any depth that fits in memory prints. When the output goes
+ * to a file it is written out every PRINT_CHUNK bytes.
+ */
+#define PRINT_CHUNK (64 * 1024)
+
+void lval_write(sbuf*, lval*, FILE*);
+void sbuf_flush(sbuf*, FILE*);
+
+lval* builtin_print_to_string(lenv*, lval*);
+
+#endif
@@ -0,0 +1,251 @@
+#include "profile.h"
+
+#include <signal.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+int profile_enabled = 0;
+volatile int profile_depth = 0;
+char* volatile profile_stack[PROFILE_DEPTH_MAX];
+
+/*
+ * Interned names
+ * A small open addressing set, names live until profile_free.
+ */
+
+static char** names = NULL;
+static int names_count = 0;
+static int names_cap = 0;
+
+static unsigned long name_hash(char* s)
+{
+	unsigned long h = 5381;
+	while (*s) { h = h * 33 + (unsigned char) *s++; }
+	return h;
+}
+
+char* profile_intern(char* s)
+{
+	if ((names_count + 1) * 2 > names_cap)
+	{
+		int cap = names_cap ? names_cap * 2 : 256;
+		char** grown = calloc(cap, sizeof(char*));
+		for (int i = 0; i < names_cap; i++)
+		{
+			if (!names[i]) { continue; }
+			unsigned long j = name_hash(names[i]) & (cap - 1);
+			while (grown[j]) { j = (j + 1) & (cap - 1); }
+			grown[j] = names[i];
+		}
+		free(names);
+		names = grown;
+		names_cap = cap;
+	}
+
+	unsigned long i = name_hash(s) & (names_cap - 1);
+	while (names[i])
+	{
+		if (strcmp(names[i], s) == 0) { return names[i]; }
+		i = (i + 1) & (names_cap - 1);
+	}
+
+	names[i] = malloc(strlen(s) + 1);
+	strcpy(names[i], s);
+	names_count++;
+	return names[i];
+}
+
+void profile_free(void)
+{
+	for (int i = 0; i < names_cap; i++) { free(names[i]); }
+	free(names);
+	names = NULL;
+	names_count = names_cap = 0;
+}
+
+/*
+ * Sampling
+ * Each sample is its depth followed by that many frames,
+ * outermost first. Once the buffer is full samples are
+ * only counted as dropped.
+ */
+
+static char** samples = NULL;
+static volatile size_t samples_len = 0;
+static volatile long samples_taken = 0;
+static volatile long samples_dropped = 0;
+
+static void profile_sample(__attribute__((unused)) int sig)
+{
+	int depth = profile_depth;
+	if (depth > PROFILE_DEPTH_MAX) { depth = PROFILE_DEPTH_MAX; }
+
+	size_t len = samples_len;
+	if (len + depth + 1 > PROFILE_SAMPLES_MAX)
+	{
+		samples_dropped++;
+		return;
+	}
+
+	samples[len] = (char*)(intptr_t) depth;
+	for (int i = 0; i < depth; i++)
+	{
+		samples[len + 1 + i] = profile_stack[i];
+	}
+	samples_len = len + depth + 1;
+	samples_taken++;
+}
+
+int profile_start(void)
+{
+	samples = malloc(sizeof(char*) * PROFILE_SAMPLES_MAX);
+	if (!samples) { return 0; }
+
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = profile_sample;
+	sa.sa_flags = SA_RESTART;
+	sigemptyset(&sa.sa_mask);
+	if (sigaction(SIGPROF, &sa, NULL) != 0) { return 0; }
+
+	struct itimerval timer;
+	timer.it_interval.tv_sec = 0;
+	timer.it_interval.tv_usec = PROFILE_INTERVAL_US;
+	timer.it_value = timer.it_interval;
+	if (setitimer(ITIMER_PROF, &timer, NULL) != 0) { return 0; }
+
+	profile_enabled = 1;
+	return 1;
+}
+
+void profile_stop(void)
+{
+	struct itimerval timer;
+	memset(&timer, 0, sizeof(timer));
+	setitimer(ITIMER_PROF, &timer, NULL);
+	signal(SIGPROF, SIG_IGN);
+	profile_enabled = 0;
+}
+
+/*
+ * Reporting
+ */
+
+typedef struct
+{
+	char* name;
+	long self;
+	long total;
+	long seen;
+} profile_entry;
+
+typedef struct
+{
+	char* stack;
+	long count;
+} profile_folded;
+
+static int entry_cmp(const void* a, const void* b)
+{
+	const profile_entry* x = a;
+	const profile_entry* y = b;
+	if (x->total != y->total) { return x->total < y->total ? 1 : -1; }
+	if (x->self != y->self) { return x->self < y->self ? 1 : -1; }
+	return strcmp(x->name, y->name);
+}
+
+static int folded_cmp(const void* a, const void* b)
+{
+	return strcmp(((const profile_folded*) a)->stack, ((const profile_folded*) b)->stack);
+}
+
+static profile_entry* entry_find(profile_entry** entries, int* count, char* name)
+{
+	for (int i = 0; i < *count; i++)
+	{
+		if ((*entries)[i].name == name) { return &(*entries)[i]; }
+	}
+	*entries = realloc(*entries, sizeof(profile_entry) * (*count + 1));
+	profile_entry* e = &(*entries)[(*count)++];
+	e->name = name;
+	e->self = e->total = 0;
+	e->seen = -1;
+	return e;
+}
+
+void profile_report(FILE* folded, FILE* table)
+{
+	profile_entry* entries = NULL;
+	int entries_count = 0;
+
+	profile_folded* stacks = malloc(sizeof(profile_folded) * (samples_taken + 1));
+	long stacks_count = 0;
+
+	long sample = 0;
+	for (size_t i = 0; i < samples_len; sample++)
+	{
+		int depth = (int)(intptr_t) samples[i];
+		char** frames = samples + i + 1;
+		i += depth + 1;
+
+		// folded line, outermost frame first
+		size_t len = strlen("<toplevel>") + 1;
+		for (int j = 0; j < depth; j++) { len += strlen(frames[j]) + 1; }
+		char* line = malloc(len);
+		strcpy(line, "<toplevel>");
+		for (int j = 0; j < depth; j++)
+		{
+			strcat(line, ";");
+			strcat(line, frames[j]);
+		}
+		stacks[stacks_count].stack = line;
+		stacks[stacks_count].count = 1;
+		stacks_count++;
+
+		// recursion only counts once towards a function's total
+		for (int j = 0; j < depth; j++)
+		{
+			profile_entry* e = entry_find(&entries, &entries_count, frames[j]);
+			if (e->seen != sample)
+			{
+				e->total++;
+				e->seen = sample;
+			}
+			if (j == depth - 1) { e->self++; }
+		}
+	}
+
+	qsort(stacks, stacks_count, sizeof(profile_folded), folded_cmp);
+	for (long i = 0; i < stacks_count; )
+	{
+		long j = i + 1;
+		while (j < stacks_count && strcmp(stacks[i].stack, stacks[j].stack) == 0) { j++; }
+		if (folded) { fprintf(folded, "%s %ld\n", stacks[i].stack, j - i); }
+		for (long k = i; k < j; k++) { free(stacks[k].stack); }
+		i = j;
+	}
+	free(stacks);
+
+	qsort(entries, entries_count, sizeof(profile_entry), entry_cmp);
+
+	if (table)
+	{
+		long n = samples_taken ? samples_taken : 1;
+		fprintf(table, "%ld samples every %dus, %ld dropped\n",
+			samples_taken, PROFILE_INTERVAL_US, samples_dropped);
+		fprintf(table, "%8s %7s %8s %7s  %s\n", "self", "self%", "total", "total%", "function");
+		for (int i = 0; i < entries_count; i++)
+		{
+			profile_entry* e = &entries[i];
+			fprintf(table, "%8ld %6.2f%% %8ld %6.2f%%  %s\n",
+				e->self, 100.0 * e->self / n, e->total, 100.0 * e->total / n, e->name);
+		}
+	}
+
+	free(entries);
+	free(samples);
+	samples = NULL;
+	samples_len = 0;
+}
@@ -0,0 +1,42 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdio.h>
+
+/*
+ * Sampling profiler for Phi code.
+ * lval_call keeps a stack of function names while
+ * profiling, and a SIGPROF timer copies that stack into
+ * a preallocated sample buffer. Names are interned, so a
+ * frame is just a pointer and lvals never own their name.
+ */
+#define PROFILE_DEPTH_MAX 256
+#define PROFILE_SAMPLES_MAX (1 << 21)
+#define PROFILE_INTERVAL_US 1000
+
+extern int profile_enabled;
+extern volatile int profile_depth;
+extern char* volatile profile_stack[PROFILE_DEPTH_MAX];
+
+char* profile_intern(char*);
+void profile_free(void);
+
+int profile_start(void);
+void profile_stop(void);
+void profile_report(FILE*, FILE*);
+
+static inline void profile_push(char* name)
+{
+	if (profile_depth < PROFILE_DEPTH_MAX)
+	{
+		profile_stack[profile_depth] = name ? name : "<lambda>";
+	}
+	profile_depth++;
+}
+
+static inline void profile_pop(void)
+{
+	profile_depth--;
+}
+
+#endif
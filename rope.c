@@ -0,0 +1,183 @@
+#include "lval.h"
+#include "rope.h"
+#include "stats.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+void rope_iter_init(rope_iter* it, lval* s)
+{
+	it->stack[0] = s;
+	it->top = 1;
+}
+
+// the bytes of the next non-empty leaf, left to right
+int rope_iter_next(rope_iter* it, char** s, long* len)
+{
+	while (it->top)
+	{
+		lval* x = it->stack[--it->top];
+		if (x->depth)
+		{
+			it->stack[it->top++] = x->right;
+			it->stack[it->top++] = x->left;
+			continue;
+		}
+		if (x->len == 0) { continue; }
+
+		*s = x->str;
+		*len = x->len;
+		return 1;
+	}
+	return 0;
+}
+
+// writes the bytes of s to to, without a NUL
+void rope_copy(char* to, lval* s)
+{
+	rope_iter it;
+	rope_iter_init(&it, s);
+	char* p;
+	long n;
+	while (rope_iter_next(&it, &p, &n))
+	{
+		memcpy(to, p, n);
+		to += n;
+	}
+}
+
+// takes l and r over
+static lval* rope_node(lval* l, lval* r)
+{
+	lval* v = lval_new(LVAL_STR);
+	v->str = NULL;
+	v->base = NULL;
+	v->mapped = 0;
+	v->left = l;
+	v->right = r;
+	v->len = l->len + r->len;
+	v->depth = 1 + (l->depth > r->depth ? l->depth : r->depth);
+	return v;
+}
+
+static lval* rope_copy_cat(lval* l, lval* r)
+{
+	lval* v = lval_str_buf(l->len + r->len);
+	rope_copy(v->str, l);
+	rope_copy(v->str + l->len, r);
+	lval_del(l);
+	lval_del(r);
+	return v;
+}
+
+/*
+ * Joins l and r, descending the deeper one until the
+ * depths are at most one apart and rotating on the way
+ * back up where the result would be out of balance.
+ */
+static lval* rope_join(lval* l, lval* r)
+{
+	if (l->depth > r->depth + 1)
+	{
+		lval* a = lval_ref(l->left);
+		lval* t = rope_join(lval_ref(l->right), r);
+		lval_del(l);
+		if (t->depth <= a->depth + 1) { return rope_node(a, t); }
+
+		lval* tl = lval_ref(t->left);
+		lval* tr = lval_ref(t->right);
+		lval_del(t);
+		if (tl->depth <= tr->depth) { return rope_node(rope_node(a, tl), tr); }
+
+		lval* tll = lval_ref(tl->left);
+		lval* tlr = lval_ref(tl->right);
+		lval_del(tl);
+		return rope_node(rope_node(a, tll), rope_node(tlr, tr));
+	}
+
+	if (r->depth > l->depth + 1)
+	{
+		lval* b = lval_ref(r->right);
+		lval* t = rope_join(l, lval_ref(r->left));
+		lval_del(r);
+		if (t->depth <= b->depth + 1) { return rope_node(t, b); }
+
+		lval* tl = lval_ref(t->left);
+		lval* tr = lval_ref(t->right);
+		lval_del(t);
+		if (tr->depth <= tl->depth) { return rope_node(tl, rope_node(tr, b)); }
+
+		lval* trl = lval_ref(tr->left);
+		lval* trr = lval_ref(tr->right);
+		lval_del(tr);
+		return rope_node(rope_node(tl, trl), rope_node(trr, b));
+	}
+
+	return rope_node(l, r);
+}
+
+// x followed by y, both are taken over
+lval* rope_cat(lval* x, lval* y)
+{
+	if (y->len == 0) { lval_del(y); return x; }
+	if (x->len == 0) { lval_del(x); return y; }
+
+	if (x->len + y->len < ROPE_MIN)
+	{
+		return rope_copy_cat(x, y);
+	}
+
+	// appending a bit at a time would otherwise leave a leaf for every bit
+	if (x->depth && !x->right->depth && x->right->len + y->len <= ROPE_LEAF)
+	{
+		lval* l = lval_ref(x->left);
+		lval* r = rope_copy_cat(lval_ref(x->right), y);
+		lval_del(x);
+		return rope_join(l, r);
+	}
+
+	return rope_join(x, y);
+}
+
+// gives s its bytes in one piece, which does not change its value
+void rope_flatten(lval* s)
+{
+	char* str = malloc(s->len + 1);
+	STATS_ADD(bytes, s->len + 1);
+	rope_copy(str, s);
+	str[s->len] = '\0';
+
+	lval_del(s->left);
+	lval_del(s->right);
+	s->depth = 0;
+	s->str = str;
+}
+
+// compares the bytes of x and y like memcmp, a prefix comes first
+int rope_cmp(lval* x, lval* y)
+{
+	if (!x->depth && !y->depth)
+	{
+		long n = x->len < y->len ? x->len : y->len;
+		int c = memcmp(x->str, y->str, n);
+		return c ? c : (x->len > y->len) - (x->len < y->len);
+	}
+
+	rope_iter ix, iy;
+	rope_iter_init(&ix, x);
+	rope_iter_init(&iy, y);
+	char *px = NULL, *py = NULL;
+	long nx = 0, ny = 0;
+	while (1)
+	{
+		if (nx == 0 && !rope_iter_next(&ix, &px, &nx)) { nx = -1; }
+		if (ny == 0 && !rope_iter_next(&iy, &py, &ny)) { ny = -1; }
+		if (nx < 0 || ny < 0) { return (nx >= 0) - (ny >= 0); }
+
+		long n = nx < ny ? nx : ny;
+		int c = memcmp(px, py, n);
+		if (c) { return c; }
+		px += n; nx -= n;
+		py += n; ny -= n;
+	}
+}
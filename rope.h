@@ -0,0 +1,37 @@
+#ifndef ROPE_H
+#define ROPE_H
+
+typedef struct lval lval;
+
+/*
+ * Ropes are strings made by concatenation without copying:
+ * a string with left and right set and no bytes of its own.
+ * They are kept balanced like AVL trees, by depth, so
+ * appending to one is O(log n). Leaves are flat strings or
+ * views. Printing, comparing and hashing walk the leaves,
+ * everything else that needs the bytes in one piece
+ * flattens the rope in place (see lval_cstr).
+ */
+
+// concatenations at least this long become ropes
+#define ROPE_MIN 256
+// short pieces appended to a rope are merged into leaves up to this long
+#define ROPE_LEAF 128
+// deeper than any rope that fits in memory
+#define ROPE_MAX_DEPTH 64
+
+typedef struct rope_iter
+{
+	lval* stack[ROPE_MAX_DEPTH + 1];
+	int top;
+} rope_iter;
+
+void rope_iter_init(rope_iter*, lval*);
+int rope_iter_next(rope_iter*, char**, long*);
+
+lval* rope_cat(lval*, lval*);
+void rope_copy(char*, lval*);
+void rope_flatten(lval*);
+int rope_cmp(lval*, lval*);
+
+#endif
@@ -9,24 +9,23 @@
 
 lval* lval_read(mpc_ast_t* t)
 {
-
-	if (strstr(t->tag, "number")) { return lval_read_num(t); }
-	if (strstr(t->tag, "symbol")) { return lval_sym(t->contents); }
-	if (strstr(t->tag, "string")) { return lval_read_str(t); }
-	
 	lval* x = NULL;
-	if (strcmp(t->tag, ">") == 0) { x = lval_sexpr(); }
-	if (strstr(t->tag, "sexpr")) { x = lval_sexpr(); }
-	if (strstr(t->tag, "qexpr")) { x = lval_qexpr(); }
 
+	switch (t->rule)
+	{
+		case PHI_NUMBER: return lval_read_num(t);
+		case PHI_SYMBOL: return lval_sym(t->contents);
+		case PHI_STRING: return lval_read_str(t);
+		case PHI_QEXPR: x = lval_qexpr(); break;
+		case PHI_SEXPR:
+		case PHI_ROOT: x = lval_sexpr(); break;
+		default: return lval_err("Unexpected rule %i (%s) in the syntax tree.", t->rule, t->tag);
+	}
+
+	// brackets and anchors never make it into the tree
 	for (int i = 0; i < t->children_num; i++)
 	{
-		if (strcmp(t->children[i]->contents, "(") == 0) { continue; }
-		if (strcmp(t->children[i]->contents, ")") == 0) { continue; }
-		if (strcmp(t->children[i]->contents, "{") == 0) { continue; }
-		if (strcmp(t->children[i]->contents, "}") == 0) { continue; }
-		if (strcmp(t->children[i]->tag, "regex") == 0) { continue; }
-		if (strstr(t->children[i]->tag, "comment")) { continue; }
+		if (t->children[i]->rule == PHI_COMMENT) { continue; }
 		x = lval_add(x, lval_read(t->children[i]));
 	}
 	
@@ -80,16 +79,16 @@ parser_elements* get_parser(void)
 {
 	parser_elements* ret = malloc(sizeof(parser_elements));
 
-	mpc_parser_t* Number = mpc_new("number");
-	mpc_parser_t* Symbol = mpc_new("symbol");
-	mpc_parser_t* String = mpc_new("string");
-	mpc_parser_t* Comment = mpc_new("comment");
-	mpc_parser_t* Sexpr = mpc_new("sexpr");
-	mpc_parser_t* Qexpr = mpc_new("qexpr");
+	mpc_parser_t* Number = mpc_rule_id(mpc_new("number"), PHI_NUMBER);
+	mpc_parser_t* Symbol = mpc_rule_id(mpc_new("symbol"), PHI_SYMBOL);
+	mpc_parser_t* String = mpc_rule_id(mpc_new("string"), PHI_STRING);
+	mpc_parser_t* Comment = mpc_rule_id(mpc_new("comment"), PHI_COMMENT);
+	mpc_parser_t* Sexpr = mpc_rule_id(mpc_new("sexpr"), PHI_SEXPR);
+	mpc_parser_t* Qexpr = mpc_rule_id(mpc_new("qexpr"), PHI_QEXPR);
 	mpc_parser_t* Expr = mpc_new("expr");
 	mpc_parser_t* Phi = mpc_new("phi");
 
-	mpca_lang(MPCA_LANG_DEFAULT,
+	mpca_lang(MPCA_LANG_DROP_LITERALS,
 		"													\
 		number	: /-?[0-9]+/ ;								\
 		symbol	: /[a-zA-Z0-9_+\\-*\\/\\\\=<>!&]+/ ;		\
@@ -1,6 +1,22 @@
 #ifndef SEMANTICS_H
 #define SEMANTICS_H
 
+/* 
+ * Rule ids set on the AST nodes produced by the grammar.
+ * The root of a parse is not produced by a rule and so
+ * has no id.
+ */
+enum
+{
+	PHI_ROOT,
+	PHI_NUMBER,
+	PHI_SYMBOL,
+	PHI_STRING,
+	PHI_COMMENT,
+	PHI_SEXPR,
+	PHI_QEXPR
+};
+
 typedef struct parser_elements
 {
 	mpc_parser_t* Number;
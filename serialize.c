@@ -0,0 +1,684 @@
+#include "lval.h"
+#include "lenv.h"
+#include "builtins.h"
+#include "serialize.h"
+#include "profile.h"
+#include "memo.h"
+#include "map.h"
+#include "hamt.h"
+#include "omap.h"
+#include "pqueue.h"
+#include "vec.h"
+#include "rope.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+/*
+ * Byte buffer
+ * All integers are written little endian so a .phic
+ * file does not depend on the host it was made on.
+ */
+
+void sbuf_put(sbuf* b, const void* p, size_t n)
+{
+	if (b->len + n > b->cap)
+	{
+		b->cap = b->cap ? b->cap * 2 : 256;
+		while (b->cap < b->len + n) { b->cap *= 2; }
+		b->data = realloc(b->data, b->cap);
+	}
+	memcpy(b->data + b->len, p, n);
+	b->len += n;
+}
+
+void sbuf_put_u8(sbuf* b, unsigned char x)
+{
+	sbuf_put(b, &x, 1);
+}
+
+void sbuf_put_u32(sbuf* b, unsigned long x)
+{
+	unsigned char bytes[4];
+	for (int i = 0; i < 4; i++) { bytes[i] = (x >> (8 * i)) & 0xff; }
+	sbuf_put(b, bytes, 4);
+}
+
+void sbuf_put_i64(sbuf* b, long long x)
+{
+	unsigned long long u = (unsigned long long) x;
+	unsigned char bytes[8];
+	for (int i = 0; i < 8; i++) { bytes[i] = (u >> (8 * i)) & 0xff; }
+	sbuf_put(b, bytes, 8);
+}
+
+// strings keep their terminator so the reader can use them in place
+void sbuf_put_str(sbuf* b, char* s)
+{
+	size_t n = strlen(s);
+	sbuf_put_u32(b, n);
+	sbuf_put(b, s, n + 1);
+}
+
+static int get_u8(char* buf, size_t len, size_t* pos, unsigned char* x)
+{
+	if (*pos + 1 > len) { return 0; }
+	*x = (unsigned char) buf[(*pos)++];
+	return 1;
+}
+
+static int get_u32(char* buf, size_t len, size_t* pos, unsigned long* x)
+{
+	if (*pos + 4 > len) { return 0; }
+	*x = 0;
+	for (int i = 0; i < 4; i++)
+	{
+		*x |= (unsigned long)(unsigned char) buf[*pos + i] << (8 * i);
+	}
+	*pos += 4;
+	return 1;
+}
+
+static int get_i64(char* buf, size_t len, size_t* pos, long long* x)
+{
+	if (*pos + 8 > len) { return 0; }
+	unsigned long long u = 0;
+	for (int i = 0; i < 8; i++)
+	{
+		u |= (unsigned long long)(unsigned char) buf[*pos + i] << (8 * i);
+	}
+	*x = (long long) u;
+	*pos += 8;
+	return 1;
+}
+
+// *n is the length, which counts any NULs inside the string
+static char* get_strn(char* buf, size_t len, size_t* pos, unsigned long* n)
+{
+	if (!get_u32(buf, len, pos, n)) { return NULL; }
+	if (*pos + *n + 1 > len || buf[*pos + *n] != '\0') { return NULL; }
+	char* s = buf + *pos;
+	*pos += *n + 1;
+	return s;
+}
+
+static char* get_str(char* buf, size_t len, size_t* pos)
+{
+	unsigned long n;
+	return get_strn(buf, len, pos, &n);
+}
+
+/*
+ * Tree encoding
+ * Every node is its type byte followed by its payload,
+ * children follow their parent in order. Functions can
+ * only be written when a builtins env is given to name
+ * (and later find) the builtins by.
+ */
+
+static char* builtin_name(lenv* names, lbuiltin f)
+{
+	for (int i = 0; i < names->count; i++)
+	{
+		if (names->vals[i]->type == LVAL_FUN && names->vals[i]->builtin == f)
+		{
+			return names->syms[i];
+		}
+	}
+	return NULL;
+}
+
+static lval* builtin_find(lenv* names, char* name)
+{
+	for (int i = 0; i < names->count; i++)
+	{
+		if (strcmp(names->syms[i], name) == 0)
+		{
+			lval* v = names->vals[i];
+			return v->type == LVAL_FUN && v->builtin ? v : NULL;
+		}
+	}
+	return NULL;
+}
+
+int lval_serialize(sbuf* b, lval* v, lenv* names)
+{
+	sbuf_put_u8(b, v->type);
+
+	switch (v->type)
+	{
+		case LVAL_NUM: sbuf_put_i64(b, v->num); return 1;
+		case LVAL_BOOL: sbuf_put_u8(b, v->bool_state); return 1;
+		case LVAL_STR:
+		{
+			// the leaves of a rope one after another, as one string
+			sbuf_put_u32(b, v->len);
+			rope_iter it;
+			rope_iter_init(&it, v);
+			char* s;
+			long n;
+			while (rope_iter_next(&it, &s, &n)) { sbuf_put(b, s, n); }
+			sbuf_put_u8(b, 0);
+			return 1;
+		}
+		case LVAL_ERR: sbuf_put_str(b, v->err); return 1;
+		case LVAL_SYM: sbuf_put_str(b, v->sym); return 1;
+
+		case LVAL_SEXPR:
+		case LVAL_QEXPR:
+			sbuf_put_u32(b, v->count);
+			for (int i = 0; i < v->count; i++)
+			{
+				if (!lval_serialize(b, v->cell[i], names)) { return 0; }
+			}
+			return 1;
+
+		case LVAL_MAP:
+			sbuf_put_u32(b, v->map->count);
+			for (int i = 0; i < v->map->count; i++)
+			{
+				if (!lval_serialize(b, v->map->entries[i].key, names)
+					|| !lval_serialize(b, v->map->entries[i].val, names))
+				{
+					return 0;
+				}
+			}
+			return 1;
+
+		case LVAL_HAMT:
+		{
+			sbuf_put_u32(b, v->hamt->count);
+			hamt_iter it;
+			hamt_iter_init(&it, v->hamt);
+			lval* key;
+			lval* val;
+			while (hamt_iter_next(&it, &key, &val))
+			{
+				if (!lval_serialize(b, key, names) || !lval_serialize(b, val, names)) { return 0; }
+			}
+			return 1;
+		}
+
+		case LVAL_OMAP:
+		{
+			sbuf_put_u32(b, v->omap->count);
+			omap_iter it;
+			omap_iter_init(&it, v->omap);
+			lval* key;
+			lval* val;
+			while (omap_iter_next(&it, &key, &val))
+			{
+				if (!lval_serialize(b, key, names) || !lval_serialize(b, val, names)) { return 0; }
+			}
+			return 1;
+		}
+
+		case LVAL_VEC:
+			sbuf_put_u32(b, v->vec->count);
+			for (long i = 0; i < v->vec->count; i++)
+			{
+				sbuf_put_i64(b, v->vec->items[i]);
+			}
+			return 1;
+
+		case LVAL_PQUEUE:
+			sbuf_put_u32(b, v->pqueue->count);
+			for (int i = 0; i < v->pqueue->count; i++)
+			{
+				sbuf_put_i64(b, v->pqueue->entries[i].prio);
+				if (!lval_serialize(b, v->pqueue->entries[i].val, names)) { return 0; }
+			}
+			return 1;
+
+		case LVAL_FUN:
+			if (!names) { return 0; }
+			if (v->builtin)
+			{
+				char* name = builtin_name(names, v->builtin);
+				if (!name) { return 0; }
+				sbuf_put_u8(b, 0);
+				sbuf_put_str(b, name);
+				return 1;
+			}
+			if (v->memo)
+			{
+				// only the function, the cache starts out empty
+				sbuf_put_u8(b, 3);
+				sbuf_put_u32(b, v->memo->size);
+				sbuf_put_u8(b, v->memo->policy);
+				return lval_serialize(b, v->memo->fn, names);
+			}
+			if (v->fn)
+			{
+				sbuf_put_u8(b, 2);
+				if (!lval_serialize(b, v->fn, names)) { return 0; }
+				sbuf_put_u32(b, v->count);
+				for (int i = 0; i < v->count; i++)
+				{
+					if (!lval_serialize(b, v->cell[i], names)) { return 0; }
+				}
+				return 1;
+			}
+			sbuf_put_u8(b, 1);
+			sbuf_put_str(b, v->name ? v->name : "");
+			return lval_serialize(b, v->formals, names)
+				&& lval_serialize(b, v->body, names);
+	}
+	return 0;
+}
+
+int lenv_serialize(sbuf* b, lenv* e, lenv* names)
+{
+	sbuf_put_u32(b, e->count);
+	for (int i = 0; i < e->count; i++)
+	{
+		sbuf_put_str(b, e->syms[i]);
+		if (!lval_serialize(b, e->vals[i], names)) { return 0; }
+	}
+	return 1;
+}
+
+int lenv_deserialize(char* buf, size_t len, size_t* pos, lenv* e, lenv* names)
+{
+	unsigned long count;
+	if (!get_u32(buf, len, pos, &count)) { return 0; }
+
+	for (unsigned long i = 0; i < count; i++)
+	{
+		char* sym = get_str(buf, len, pos);
+		if (!sym) { return 0; }
+
+		lval* v = lval_deserialize(buf, len, pos, names);
+		if (!v) { return 0; }
+
+		lval* k = lval_sym(sym);
+		lenv_put(e, k, v);
+		lval_del(k); lval_del(v);
+	}
+	return 1;
+}
+
+lval* lval_deserialize(char* buf, size_t len, size_t* pos, lenv* names)
+{
+	unsigned char type;
+	if (!get_u8(buf, len, pos, &type)) { return NULL; }
+
+	switch (type)
+	{
+		case LVAL_NUM:
+		{
+			long long x;
+			if (!get_i64(buf, len, pos, &x)) { return NULL; }
+			return lval_num(x);
+		}
+		case LVAL_BOOL:
+		{
+			unsigned char x;
+			if (!get_u8(buf, len, pos, &x)) { return NULL; }
+			return lval_bool(x);
+		}
+		case LVAL_STR:
+		{
+			unsigned long n;
+			char* s = get_strn(buf, len, pos, &n);
+			if (!s) { return NULL; }
+			return lval_strn(s, n);
+		}
+		case LVAL_ERR:
+		case LVAL_SYM:
+		{
+			char* s = get_str(buf, len, pos);
+			if (!s) { return NULL; }
+			if (type == LVAL_SYM) { return lval_sym(s); }
+			return lval_err("%s", s);
+		}
+		case LVAL_SEXPR:
+		case LVAL_QEXPR:
+		{
+			unsigned long count;
+			if (!get_u32(buf, len, pos, &count)) { return NULL; }
+
+			// a child takes at least one byte, so this bounds the allocation
+			if (count > len - *pos) { return NULL; }
+
+			lval* x = type == LVAL_SEXPR ? lval_sexpr() : lval_qexpr();
+			x->cell = malloc(sizeof(lval*) * count);
+			for (x->count = 0; x->count < (int) count; x->count++)
+			{
+				lval* c = lval_deserialize(buf, len, pos, names);
+				if (!c) { lval_del(x); return NULL; }
+				x->cell[x->count] = c;
+			}
+			return x;
+		}
+		case LVAL_MAP:
+		case LVAL_HAMT:
+		case LVAL_OMAP:
+		{
+			unsigned long count;
+			if (!get_u32(buf, len, pos, &count)) { return NULL; }
+
+			lval* x = type == LVAL_MAP ? lval_map() : type == LVAL_HAMT ? lval_hamt() : lval_omap();
+			for (unsigned long i = 0; i < count; i++)
+			{
+				lval* k = lval_deserialize(buf, len, pos, names);
+				lval* v = k ? lval_deserialize(buf, len, pos, names) : NULL;
+				if (!v || !(type == LVAL_OMAP ? lomap_key_ok(k) : lmap_key_ok(k)))
+				{
+					if (k) { lval_del(k); }
+					if (v) { lval_del(v); }
+					lval_del(x);
+					return NULL;
+				}
+				if (type == LVAL_MAP) { lmap_put(x->map, k, v); }
+				else if (type == LVAL_HAMT) { lhamt_put(x->hamt, k, v); }
+				else { lomap_put(x->omap, k, v); }
+			}
+			return x;
+		}
+		case LVAL_VEC:
+		{
+			unsigned long count;
+			if (!get_u32(buf, len, pos, &count) || count > (len - *pos) / 8) { return NULL; }
+
+			long* items = malloc(sizeof(long) * count);
+			for (unsigned long i = 0; i < count; i++)
+			{
+				// the count was checked against what is left
+				long long x = 0;
+				get_i64(buf, len, pos, &x);
+				items[i] = x;
+			}
+			return lval_vec(items, count);
+		}
+		case LVAL_PQUEUE:
+		{
+			unsigned long count;
+			if (!get_u32(buf, len, pos, &count)) { return NULL; }
+
+			// entries are written in heap order, so pushing them keeps it
+			lval* x = lval_pqueue();
+			for (unsigned long i = 0; i < count; i++)
+			{
+				long long prio;
+				lval* v = get_i64(buf, len, pos, &prio) ? lval_deserialize(buf, len, pos, names) : NULL;
+				if (!v) { lval_del(x); return NULL; }
+				lpqueue_push(x->pqueue, prio, v);
+			}
+			return x;
+		}
+		case LVAL_FUN:
+		{
+			unsigned char kind;
+			if (!names || !get_u8(buf, len, pos, &kind)) { return NULL; }
+
+			if (kind == 0)
+			{
+				char* name = get_str(buf, len, pos);
+				lval* f = name ? builtin_find(names, name) : NULL;
+				return f ? lval_copy(f) : NULL;
+			}
+
+			if (kind == 3)
+			{
+				unsigned long size;
+				unsigned char policy;
+				if (!get_u32(buf, len, pos, &size) || !get_u8(buf, len, pos, &policy)
+					|| size > (1 << 30) || policy > MEMO_LRU)
+				{
+					return NULL;
+				}
+
+				lval* fn = lval_deserialize(buf, len, pos, names);
+				if (!fn) { return NULL; }
+				if (fn->type != LVAL_FUN)
+				{
+					lval_del(fn);
+					return NULL;
+				}
+				return lval_memo(fn, size, policy);
+			}
+
+			if (kind == 2)
+			{
+				lval* fn = lval_deserialize(buf, len, pos, names);
+				if (!fn) { return NULL; }
+
+				unsigned long count;
+				if (fn->type != LVAL_FUN || fn->builtin || fn->fn || !get_u32(buf, len, pos, &count)
+					|| count > len - *pos)
+				{
+					lval_del(fn);
+					return NULL;
+				}
+
+				lval* p = lval_partial(fn);
+				p->cell = malloc(sizeof(lval*) * count);
+				for (; p->count < (int) count; p->count++)
+				{
+					lval* c = lval_deserialize(buf, len, pos, names);
+					if (!c) { lval_del(p); return NULL; }
+					p->cell[p->count] = c;
+				}
+				return p;
+			}
+
+			char* name = get_str(buf, len, pos);
+			if (!name) { return NULL; }
+
+			lval* formals = lval_deserialize(buf, len, pos, names);
+			lval* body = formals ? lval_deserialize(buf, len, pos, names) : NULL;
+			if (!body)
+			{
+				if (formals) { lval_del(formals); }
+				return NULL;
+			}
+
+			lval* f = lval_lambda(formals, body);
+			f->name = *name ? profile_intern(name) : NULL;
+			return f;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Module cache
+ */
+
+int lval_cache_enabled = 1;
+
+char* lval_cache_path(char* path)
+{
+	size_t n = strlen(path);
+	char* cache = malloc(n + 6);
+	strcpy(cache, path);
+
+	if (n >= 4 && strcmp(path + n - 4, ".phi") == 0)
+	{
+		strcat(cache, "c");
+	} else {
+		strcat(cache, ".phic");
+	}
+	return cache;
+}
+
+static void put_header(sbuf* b, struct stat* st)
+{
+	sbuf_put(b, PHIC_MAGIC, 4);
+	sbuf_put_u32(b, PHIC_VERSION);
+	// nanoseconds too, an edit that keeps the size can land in the same second
+	sbuf_put_i64(b, st->st_mtim.tv_sec);
+	sbuf_put_i64(b, st->st_mtim.tv_nsec);
+	sbuf_put_i64(b, st->st_size);
+}
+
+lval* lval_cache_load(char* path)
+{
+	struct stat st;
+	if (stat(path, &st) != 0) { return NULL; }
+
+	char* cache = lval_cache_path(path);
+	FILE* f = fopen(cache, "rb");
+	free(cache);
+	if (!f) { return NULL; }
+
+	fseek(f, 0, SEEK_END);
+	long len = ftell(f);
+	fseek(f, 0, SEEK_SET);
+
+	if (len <= 0)
+	{
+		fclose(f);
+		return NULL;
+	}
+
+	char* buf = malloc(len);
+	size_t got = fread(buf, 1, len, f);
+	fclose(f);
+
+	// the header has to match what we would write for the source now
+	sbuf header = {0};
+	put_header(&header, &st);
+
+	lval* v = NULL;
+	if (got == (size_t) len && got > header.len
+		&& memcmp(buf, header.data, header.len) == 0)
+	{
+		size_t pos = header.len;
+		v = lval_deserialize(buf, len, &pos, NULL);
+		if (v && pos != got)
+		{
+			lval_del(v);
+			v = NULL;
+		}
+	}
+
+	free(header.data);
+	free(buf);
+	return v;
+}
+
+int lval_cache_store(char* path, lval* v)
+{
+	struct stat st;
+	if (stat(path, &st) != 0) { return 0; }
+
+	sbuf b = {0};
+	put_header(&b, &st);
+
+	if (!lval_serialize(&b, v, NULL))
+	{
+		free(b.data);
+		return 0;
+	}
+
+	// write to a temporary and rename so readers never see half a file
+	char* cache = lval_cache_path(path);
+	char* tmp = malloc(strlen(cache) + 5);
+	sprintf(tmp, "%s.tmp", cache);
+
+	int ok = 0;
+	FILE* f = fopen(tmp, "wb");
+	if (f)
+	{
+		ok = fwrite(b.data, 1, b.len, f) == b.len;
+		ok = (fclose(f) == 0) && ok;
+		ok = ok && rename(tmp, cache) == 0;
+		if (!ok) { remove(tmp); }
+	}
+
+	free(tmp);
+	free(cache);
+	free(b.data);
+	return ok;
+}
+
+/*
+ * Images
+ */
+
+int lenv_image_encode(sbuf* b, lenv* e)
+{
+	lenv* names = lenv_new();
+	lenv_add_builtins(names);
+
+	sbuf_put(b, PHII_MAGIC, 4);
+	sbuf_put_u32(b, PHII_VERSION);
+
+	int ok = lenv_serialize(b, e, names);
+	lenv_del(names);
+	return ok;
+}
+
+int lenv_image_decode(const unsigned char* data, size_t len, lenv* e)
+{
+	char* buf = (char*) data;
+
+	sbuf header = {0};
+	sbuf_put(&header, PHII_MAGIC, 4);
+	sbuf_put_u32(&header, PHII_VERSION);
+
+	int ok = len > header.len && memcmp(buf, header.data, header.len) == 0;
+
+	if (ok)
+	{
+		// the builtins give the names to relocate against
+		lenv* names = lenv_new();
+		lenv_add_builtins(names);
+
+		size_t pos = header.len;
+		ok = lenv_deserialize(buf, len, &pos, e, names) && pos == len;
+
+		lenv_del(names);
+	}
+
+	free(header.data);
+	return ok;
+}
+
+int lenv_image_dump(char* path, lenv* e)
+{
+	sbuf b = {0};
+	int ok = lenv_image_encode(&b, e);
+
+	FILE* f = ok ? fopen(path, "wb") : NULL;
+	if (f)
+	{
+		ok = fwrite(b.data, 1, b.len, f) == b.len;
+		ok = (fclose(f) == 0) && ok;
+	} else {
+		ok = 0;
+	}
+
+	free(b.data);
+	return ok;
+}
+
+int lenv_image_load(char* path, lenv* e)
+{
+	FILE* f = fopen(path, "rb");
+	if (!f) { return 0; }
+
+	fseek(f, 0, SEEK_END);
+	long len = ftell(f);
+	fseek(f, 0, SEEK_SET);
+
+	if (len <= 0)
+	{
+		fclose(f);
+		return 0;
+	}
+
+	char* buf = malloc(len);
+	size_t got = fread(buf, 1, len, f);
+	fclose(f);
+
+	int ok = got == (size_t) len
+		&& lenv_image_decode((unsigned char*) buf, len, e);
+
+	free(buf);
+	return ok;
+}
@@ -0,0 +1,57 @@
+#ifndef SERIALIZE_H
+#define SERIALIZE_H
+
+#include <stddef.h>
+
+typedef struct lval lval;
+typedef struct lenv lenv;
+
+/*
+ * Precompiled modules (.phic) are the read lval tree of
+ * a source file, written next to it and keyed on the
+ * mtime, to the nanosecond, and size of the source. Bump
+ * PHIC_VERSION whenever the encoding or the reader changes.
+ */
+#define PHIC_MAGIC "PHIC"
+#define PHIC_VERSION 1
+
+// load neither reads nor writes .phic files while this is 0
+extern int lval_cache_enabled;
+
+/*
+ * Images (--dump-image / --image) hold every binding of
+ * the global env, lambdas and their captured envs included.
+ * Builtins are written by name and relocated against the
+ * builtins of the process that loads the image.
+ */
+#define PHII_MAGIC "PHII"
+#define PHII_VERSION 9
+
+typedef struct sbuf
+{
+	char* data;
+	size_t len;
+	size_t cap;
+} sbuf;
+
+void sbuf_put(sbuf*, const void*, size_t);
+void sbuf_put_u8(sbuf*, unsigned char);
+void sbuf_put_u32(sbuf*, unsigned long);
+void sbuf_put_i64(sbuf*, long long);
+void sbuf_put_str(sbuf*, char*);
+
+int lval_serialize(sbuf*, lval*, lenv*);
+lval* lval_deserialize(char*, size_t, size_t*, lenv*);
+int lenv_serialize(sbuf*, lenv*, lenv*);
+int lenv_deserialize(char*, size_t, size_t*, lenv*, lenv*);
+
+char* lval_cache_path(char*);
+lval* lval_cache_load(char*);
+int lval_cache_store(char*, lval*);
+
+int lenv_image_encode(sbuf*, lenv*);
+int lenv_image_decode(const unsigned char*, size_t, lenv*);
+int lenv_image_dump(char*, lenv*);
+int lenv_image_load(char*, lenv*);
+
+#endif
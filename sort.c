@@ -0,0 +1,305 @@
+#include "lval.h"
+#include "lenv.h"
+#include "sort.h"
+#include "ordering.h"
+#include "builtins.h"
+#include "expressions.h"
+#include "common.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// key decides the order, val is what ends up in the list
+typedef struct sort_item
+{
+	lval* key;
+	lval* val;
+} sort_item;
+
+typedef struct sort_ctx
+{
+	lenv* env;
+	// comparator, NULL for lval_cmp
+	lval* fn;
+	// first error the comparator gave, the sort winds down after it
+	lval* err;
+	char* func;
+} sort_ctx;
+
+static int sort_less(sort_ctx* c, sort_item* x, sort_item* y)
+{
+	if (!c->fn)
+	{
+		return lval_cmp(x->key, y->key) < 0;
+	}
+	if (c->err)
+	{
+		return 0;
+	}
+
+	lval* args = lval_add(lval_sexpr(), lval_ref(x->key));
+	args = lval_add(args, lval_ref(y->key));
+	lval* r = lval_call(c->env, c->fn, args);
+
+	if (r->type == LVAL_BOOL)
+	{
+		int less = r->bool_state;
+		lval_del(r);
+		return less;
+	}
+
+	if (r->type == LVAL_ERR)
+	{
+		c->err = r;
+	} else {
+		c->err = lval_err("Function '%s' comparator returned %s, expected %s.",
+			c->func, ltype_name(r->type), ltype_name(LVAL_BOOL));
+		lval_del(r);
+	}
+	return 0;
+}
+
+/*
+ * Introsort
+ */
+
+static void item_swap(sort_item* a, int i, int j)
+{
+	sort_item t = a[i];
+	a[i] = a[j];
+	a[j] = t;
+}
+
+static void insertion_sort(sort_ctx* c, sort_item* a, int n)
+{
+	for (int i = 1; i < n; i++)
+	{
+		sort_item x = a[i];
+		int j = i;
+		for (; j > 0 && sort_less(c, &x, &a[j - 1]); j--)
+		{
+			a[j] = a[j - 1];
+		}
+		a[j] = x;
+	}
+}
+
+static void sift_down(sort_ctx* c, sort_item* a, int i, int n)
+{
+	while (2 * i + 1 < n)
+	{
+		int child = 2 * i + 1;
+		if (child + 1 < n && sort_less(c, &a[child], &a[child + 1])) { child++; }
+		if (!sort_less(c, &a[i], &a[child])) { return; }
+		item_swap(a, i, child);
+		i = child;
+	}
+}
+
+static void heap_sort(sort_ctx* c, sort_item* a, int n)
+{
+	for (int i = n / 2 - 1; i >= 0; i--) { sift_down(c, a, i, n); }
+	for (int end = n - 1; end > 0; end--)
+	{
+		item_swap(a, 0, end);
+		sift_down(c, a, 0, end);
+	}
+}
+
+static void intro_sort(sort_ctx* c, sort_item* a, int n, int depth)
+{
+	while (n > SORT_INSERTION_MAX && !c->err)
+	{
+		if (depth-- == 0)
+		{
+			heap_sort(c, a, n);
+			return;
+		}
+
+		// median of three ends up at a[0] and serves as the pivot
+		int mid = n / 2;
+		if (sort_less(c, &a[mid], &a[0])) { item_swap(a, mid, 0); }
+		if (sort_less(c, &a[n - 1], &a[0])) { item_swap(a, n - 1, 0); }
+		if (sort_less(c, &a[n - 1], &a[mid])) { item_swap(a, n - 1, mid); }
+		item_swap(a, 0, mid);
+
+		// Hoare partition around a[0]
+		int i = 0;
+		int j = n;
+		while (1)
+		{
+			do { i++; } while (i < n && sort_less(c, &a[i], &a[0]));
+			do { j--; } while (j > 0 && sort_less(c, &a[0], &a[j]));
+			if (i >= j) { break; }
+			item_swap(a, i, j);
+		}
+		item_swap(a, 0, j);
+
+		// recurse into the smaller side, loop on the larger
+		if (j < n - j - 1)
+		{
+			intro_sort(c, a, j, depth);
+			a += j + 1;
+			n -= j + 1;
+		} else {
+			intro_sort(c, a + j + 1, n - j - 1, depth);
+			n = j;
+		}
+	}
+
+	if (!c->err)
+	{
+		insertion_sort(c, a, n);
+	}
+}
+
+/*
+ * Radix sort, for keys that are all numbers. Least
+ * significant byte first, with the sign bit flipped so
+ * negative numbers come first, skipping bytes every key
+ * has in common.
+ */
+static void radix_sort(sort_item* a, int n)
+{
+	sort_item* tmp = malloc(sizeof(sort_item) * n);
+	unsigned long long* bits = malloc(sizeof(unsigned long long) * n);
+	unsigned long long* tmp_bits = malloc(sizeof(unsigned long long) * n);
+
+	for (int i = 0; i < n; i++)
+	{
+		bits[i] = (unsigned long long) a[i].key->num ^ (1ULL << 63);
+	}
+
+	for (int shift = 0; shift < 64; shift += 8)
+	{
+		int counts[257] = { 0 };
+		for (int i = 0; i < n; i++) { counts[((bits[i] >> shift) & 0xff) + 1]++; }
+
+		if (counts[((bits[0] >> shift) & 0xff) + 1] == n) { continue; }
+
+		for (int b = 0; b < 256; b++) { counts[b + 1] += counts[b]; }
+		for (int i = 0; i < n; i++)
+		{
+			int to = counts[(bits[i] >> shift) & 0xff]++;
+			tmp[to] = a[i];
+			tmp_bits[to] = bits[i];
+		}
+
+		memcpy(a, tmp, sizeof(sort_item) * n);
+		memcpy(bits, tmp_bits, sizeof(unsigned long long) * n);
+	}
+
+	free(tmp);
+	free(bits);
+	free(tmp_bits);
+}
+
+// sorts the items of l by their keys and puts their vals back into l
+static lval* sort_items(sort_ctx* c, lval* l, sort_item* items)
+{
+	int n = l->count;
+	int numbers = 1;
+	for (int i = 0; i < n; i++)
+	{
+		if (items[i].key->type != LVAL_NUM) { numbers = 0; }
+	}
+
+	if (!c->fn && numbers)
+	{
+		if (n > 1) { radix_sort(items, n); }
+	} else {
+		int depth = 0;
+		for (int m = n; m > 1; m /= 2) { depth += 2; }
+		intro_sort(c, items, n, depth);
+	}
+
+	if (c->err)
+	{
+		lval_del(l);
+		return c->err;
+	}
+
+	for (int i = 0; i < n; i++)
+	{
+		l->cell[i] = items[i].val;
+	}
+	l->hash = 0;
+	return l;
+}
+
+// (sort list) or (sort list less), less says whether its first argument goes first
+lval* builtin_sort(lenv* e, lval* a)
+{
+	LASSERT(a, a->count == 1 || a->count == 2,
+		"Function 'sort' passed incorrect number of arguments. "
+		"Got %i, Expected 1 or 2.", a->count);
+	LASSERT_TYPE("sort", a, 0, LVAL_QEXPR);
+
+	sort_ctx c = { e, NULL, NULL, "sort" };
+	if (a->count == 2)
+	{
+		LASSERT_TYPE("sort", a, 1, LVAL_FUN);
+		c.fn = a->cell[1];
+	} else {
+		lval* l = a->cell[0];
+		for (int i = 0; i < l->count; i++)
+		{
+			LASSERT(a, l->cell[i]->type == LVAL_NUM || l->cell[i]->type == LVAL_STR,
+				"Function 'sort' can only order numbers and strings without a "
+				"comparator, got %s at %i.", ltype_name(l->cell[i]->type), i);
+		}
+	}
+
+	lval* l = lval_own(lval_pop(a, 0));
+	sort_item* items = malloc(sizeof(sort_item) * l->count);
+	for (int i = 0; i < l->count; i++)
+	{
+		items[i].key = items[i].val = l->cell[i];
+	}
+
+	lval* x = sort_items(&c, l, items);
+	free(items);
+	lval_del(a);
+	return x;
+}
+
+// (sort-by f list) orders list by (f element), computed once for each element
+lval* builtin_sort_by(lenv* e, lval* a)
+{
+	LASSERT_NUM("sort-by", a, 2);
+	LASSERT_TYPE("sort-by", a, 0, LVAL_FUN);
+	LASSERT_TYPE("sort-by", a, 1, LVAL_QEXPR);
+
+	lval* f = a->cell[0];
+	lval* l = lval_own(lval_pop(a, 1));
+	sort_item* items = malloc(sizeof(sort_item) * l->count);
+
+	for (int i = 0; i < l->count; i++)
+	{
+		lval* key = lval_call(e, f, lval_add(lval_sexpr(), lval_ref(l->cell[i])));
+		if (key->type != LVAL_NUM && key->type != LVAL_STR)
+		{
+			lval* err = key->type == LVAL_ERR ? key : lval_err(
+				"Function 'sort-by' key function returned %s at %i, "
+				"expected a number or a string.", ltype_name(key->type), i);
+			if (err != key) { lval_del(key); }
+
+			for (int j = 0; j < i; j++) { lval_del(items[j].key); }
+			free(items);
+			lval_del(l);
+			lval_del(a);
+			return err;
+		}
+		items[i].key = key;
+		items[i].val = l->cell[i];
+	}
+
+	sort_ctx c = { e, NULL, NULL, "sort-by" };
+	int n = l->count;
+	lval* x = sort_items(&c, l, items);
+
+	for (int i = 0; i < n; i++) { lval_del(items[i].key); }
+	free(items);
+	lval_del(a);
+	return x;
+}
@@ -0,0 +1,22 @@
+#ifndef SORT_H
+#define SORT_H
+
+typedef struct lval lval;
+typedef struct lenv lenv;
+
+/*
+ * Sorting q-expressions in place. Elements are ordered by
+ * lval_cmp, or by a comparator function that says whether
+ * its first argument goes before its second. Comparison
+ * sorts are introsort: quicksort on the median of three,
+ * heapsort once the recursion gets too deep and insertion
+ * sort for short runs. Numbers without a comparator are
+ * radix sorted instead. Neither keeps equal elements in
+ * their original order.
+ */
+#define SORT_INSERTION_MAX 16
+
+lval* builtin_sort(lenv*, lval*);
+lval* builtin_sort_by(lenv*, lval*);
+
+#endif
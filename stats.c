@@ -0,0 +1,111 @@
+#include "lval.h"
+#include "stats.h"
+#include "expressions.h"
+#include "common.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+phi_stats stats;
+
+typedef struct
+{
+	char* name;
+	long value;
+} stats_entry;
+
+// counters are looked up by symbol, so no spaces as in ltype_name
+static char* stats_type_names[LVAL_TYPE_COUNT] =
+{
+	[LVAL_NUM] = "num",
+	[LVAL_STR] = "str",
+	[LVAL_ERR] = "err",
+	[LVAL_SYM] = "sym",
+	[LVAL_SEXPR] = "sexpr",
+	[LVAL_QEXPR] = "qexpr",
+	[LVAL_FUN] = "fun",
+	[LVAL_BOOL] = "bool",
+	[LVAL_MAP] = "map",
+	[LVAL_HAMT] = "hamt",
+	[LVAL_OMAP] = "omap",
+	[LVAL_PQUEUE] = "pqueue",
+	[LVAL_FILE] = "file",
+	[LVAL_VEC] = "vec",
+};
+
+static int stats_entries(stats_entry* out)
+{
+	static char names[LVAL_TYPE_COUNT][32];
+	int n = 0;
+
+	for (int t = 0; t < LVAL_TYPE_COUNT; t++)
+	{
+		snprintf(names[t], sizeof(names[t]), "allocs-%s", stats_type_names[t]);
+		out[n++] = (stats_entry) { names[t], stats.allocs[t] };
+	}
+
+	out[n++] = (stats_entry) { "bytes", stats.bytes };
+	out[n++] = (stats_entry) { "live", stats.live };
+	out[n++] = (stats_entry) { "peak-live", stats.peak_live };
+	out[n++] = (stats_entry) { "copies", stats.copies };
+	out[n++] = (stats_entry) { "env-copies", stats.env_copies };
+	out[n++] = (stats_entry) { "env-lookups", stats.env_lookups };
+	out[n++] = (stats_entry) { "env-depth", stats.env_depth };
+	out[n++] = (stats_entry) { "env-depth-max", stats.env_depth_max };
+	out[n++] = (stats_entry) { "calls", stats.calls };
+	out[n++] = (stats_entry) { "builtin-calls", stats.builtin_calls };
+	out[n++] = (stats_entry) { "add-reallocs", stats.add_reallocs };
+	out[n++] = (stats_entry) { "err-formats", stats.err_formats };
+	out[n++] = (stats_entry) { "hash-cons-hits", stats.hash_cons_hits };
+
+	return n;
+}
+
+void stats_print(FILE* f)
+{
+	stats_entry entries[STATS_TYPES + 16];
+	int n = stats_entries(entries);
+
+	for (int i = 0; i < n; i++)
+	{
+		fprintf(f, "%-24s %ld\n", entries[i].name, entries[i].value);
+	}
+}
+
+/*
+ * (stats {}) gives {{name value} ...} for every counter,
+ * (stats {calls copies}) only the named ones. A lone
+ * (stats) evaluates to the builtin itself, like any
+ * single element s-expression.
+ */
+lval* builtin_stats(__attribute__((unused)) lenv* e, lval* a)
+{
+	LASSERT_NUM("stats", a, 1);
+	LASSERT_TYPE("stats", a, 0, LVAL_QEXPR);
+
+	// read before the result itself allocates anything
+	stats_entry entries[STATS_TYPES + 16];
+	int n = stats_entries(entries);
+
+	lval* names = a->cell[0];
+	lval* x = lval_qexpr();
+	for (int i = 0; i < n; i++)
+	{
+		int wanted = names->count == 0;
+		for (int j = 0; j < names->count && !wanted; j++)
+		{
+			wanted = names->cell[j]->type == LVAL_SYM
+				&& strcmp(names->cell[j]->sym, entries[i].name) == 0;
+		}
+		if (!wanted) { continue; }
+
+		lval* pair = lval_qexpr();
+		pair = lval_add(pair, lval_sym(entries[i].name));
+		pair = lval_add(pair, lval_num(entries[i].value));
+		x = lval_add(x, pair);
+	}
+
+	lval_del(a);
+	return x;
+}
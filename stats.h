@@ -0,0 +1,49 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+
+typedef struct lval lval;
+typedef struct lenv lenv;
+
+/*
+ * Interpreter counters. They are always compiled in and
+ * are plain increments on a global, nothing is formatted
+ * or reported unless (stats) or --stats asks for it.
+ */
+#define STATS_TYPES 32
+
+typedef struct phi_stats
+{
+	long allocs[STATS_TYPES];
+	long bytes;
+	long live;
+	long peak_live;
+	long copies;
+	long env_copies;
+	long env_lookups;
+	long env_depth;
+	long env_depth_max;
+	long calls;
+	long builtin_calls;
+	long add_reallocs;
+	long err_formats;
+	long hash_cons_hits;
+} phi_stats;
+
+extern phi_stats stats;
+
+#define STATS_INC(field) (stats.field++)
+#define STATS_ADD(field, n) (stats.field += (n))
+
+static inline void stats_alloc(int type, long size)
+{
+	stats.allocs[type]++;
+	stats.bytes += size;
+	if (++stats.live > stats.peak_live) { stats.peak_live = stats.live; }
+}
+
+void stats_print(FILE*);
+lval* builtin_stats(lenv*, lval*);
+
+#endif
@@ -0,0 +1,183 @@
+#include "lval.h"
+#include "lenv.h"
+#include "str.h"
+#include "rope.h"
+#include "expressions.h"
+#include "common.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// index of the first n bytes of p in s at or after from, -1 if there is none
+static long str_find(char* s, long len, char* p, long n, long from)
+{
+	if (n == 0) { return from; }
+
+	char* cur = s + from;
+	// last place a match can start
+	char* end = s + len - n;
+	while (cur <= end)
+	{
+		// memchr skips ahead to candidates a word or more at a time
+		cur = memchr(cur, p[0], end - cur + 1);
+		if (!cur) { break; }
+		if (memcmp(cur + 1, p + 1, n - 1) == 0) { return cur - s; }
+		cur++;
+	}
+	return -1;
+}
+
+// ropes are searched and sliced in one piece, views already are one
+static void str_flat(lval* s)
+{
+	if (s->depth) { rope_flatten(s); }
+}
+
+lval* builtin_str_len(__attribute__((unused)) lenv* e, lval* a)
+{
+	LASSERT_NUM("str-len", a, 1);
+	LASSERT_TYPE("str-len", a, 0, LVAL_STR);
+
+	lval* x = lval_num(a->cell[0]->len);
+	lval_del(a);
+	return x;
+}
+
+/*
+ * (str-cat s ...) copies every argument once into a string
+ * of the total length, or makes a rope of them if that is
+ * long enough.
+ */
+lval* builtin_str_cat(__attribute__((unused)) lenv* e, lval* a)
+{
+	long len = 0;
+	for (int i = 0; i < a->count; i++)
+	{
+		LASSERT_TYPE("str-cat", a, i, LVAL_STR);
+		len += a->cell[i]->len;
+	}
+
+	if (len >= ROPE_MIN)
+	{
+		lval* x = lval_pop(a, 0);
+		while (a->count) { x = rope_cat(x, lval_pop(a, 0)); }
+		lval_del(a);
+		return x;
+	}
+
+	lval* x = lval_str_buf(len);
+	char* to = x->str;
+	for (int i = 0; i < a->count; i++)
+	{
+		memcpy(to, a->cell[i]->str, a->cell[i]->len);
+		to += a->cell[i]->len;
+	}
+
+	lval_del(a);
+	return x;
+}
+
+// (substr s start) or (substr s start end), the bytes from start up to end
+lval* builtin_substr(__attribute__((unused)) lenv* e, lval* a)
+{
+	LASSERT(a, a->count == 2 || a->count == 3,
+		"Function 'substr' passed incorrect number of arguments. "
+		"Got %i, Expected 2 or 3.", a->count);
+	LASSERT_TYPE("substr", a, 0, LVAL_STR);
+	LASSERT_TYPE("substr", a, 1, LVAL_NUM);
+	if (a->count == 3) { LASSERT_TYPE("substr", a, 2, LVAL_NUM); }
+
+	lval* s = a->cell[0];
+	str_flat(s);
+	long start = a->cell[1]->num;
+	long end = a->count == 3 ? a->cell[2]->num : s->len;
+	LASSERT(a, 0 <= start && start <= end && end <= s->len,
+		"Function 'substr' passed range %li to %li, outside a string of length %li.",
+		start, end, s->len);
+
+	lval* x = lval_str_view(s, start, end - start);
+	lval_del(a);
+	return x;
+}
+
+// (str-find s p) or (str-find s p from), where p first occurs in s, -1 if it does not
+lval* builtin_str_find(__attribute__((unused)) lenv* e, lval* a)
+{
+	LASSERT(a, a->count == 2 || a->count == 3,
+		"Function 'str-find' passed incorrect number of arguments. "
+		"Got %i, Expected 2 or 3.", a->count);
+	LASSERT_TYPE("str-find", a, 0, LVAL_STR);
+	LASSERT_TYPE("str-find", a, 1, LVAL_STR);
+	if (a->count == 3) { LASSERT_TYPE("str-find", a, 2, LVAL_NUM); }
+
+	lval* s = a->cell[0];
+	lval* p = a->cell[1];
+	str_flat(s);
+	str_flat(p);
+	long from = a->count == 3 ? a->cell[2]->num : 0;
+	LASSERT(a, 0 <= from && from <= s->len,
+		"Function 'str-find' passed start %li, outside a string of length %li.",
+		from, s->len);
+
+	lval* x = lval_num(str_find(s->str, s->len, p->str, p->len, from));
+	lval_del(a);
+	return x;
+}
+
+// (str-split s sep) the pieces of s between occurrences of sep
+lval* builtin_str_split(__attribute__((unused)) lenv* e, lval* a)
+{
+	LASSERT_NUM("str-split", a, 2);
+	LASSERT_TYPE("str-split", a, 0, LVAL_STR);
+	LASSERT_TYPE("str-split", a, 1, LVAL_STR);
+	LASSERT(a, a->cell[1]->len != 0, "Function 'str-split' passed an empty separator!");
+
+	lval* s = a->cell[0];
+	lval* sep = a->cell[1];
+	str_flat(s);
+	str_flat(sep);
+	lval* x = lval_qexpr();
+	long start = 0;
+	while (1)
+	{
+		long at = str_find(s->str, s->len, sep->str, sep->len, start);
+		if (at < 0) { break; }
+		x = lval_add(x, lval_str_view(s, start, at - start));
+		start = at + sep->len;
+	}
+	x = lval_add(x, lval_str_view(s, start, s->len - start));
+
+	lval_del(a);
+	return x;
+}
+
+// (str->num s) reads s as a number, all of it
+lval* builtin_str_to_num(__attribute__((unused)) lenv* e, lval* a)
+{
+	LASSERT_NUM("str->num", a, 1);
+	LASSERT_TYPE("str->num", a, 0, LVAL_STR);
+
+	char* s = lval_cstr(a->cell[0]);
+	char* end;
+	errno = 0;
+	long x = strtol(s, &end, 10);
+	LASSERT(a, end != s && *end == '\0' && errno != ERANGE,
+		"Function 'str->num' passed \"%s\", which is not a number.", s);
+
+	lval_del(a);
+	return lval_num(x);
+}
+
+lval* builtin_num_to_str(__attribute__((unused)) lenv* e, lval* a)
+{
+	LASSERT_NUM("num->str", a, 1);
+	LASSERT_TYPE("num->str", a, 0, LVAL_NUM);
+
+	char buf[32];
+	int len = snprintf(buf, sizeof(buf), "%li", a->cell[0]->num);
+
+	lval_del(a);
+	return lval_strn(buf, len);
+}
@@ -0,0 +1,21 @@
+#ifndef STR_H
+#define STR_H
+
+typedef struct lval lval;
+typedef struct lenv lenv;
+
+/*
+ * String builtins. Positions are byte offsets from 0.
+ * substr and str-split give views into the string they
+ * are passed rather than copies (see lval_str_view), and
+ * long results of str-cat are ropes (see rope.h).
+ */
+lval* builtin_str_len(lenv*, lval*);
+lval* builtin_str_cat(lenv*, lval*);
+lval* builtin_substr(lenv*, lval*);
+lval* builtin_str_find(lenv*, lval*);
+lval* builtin_str_split(lenv*, lval*);
+lval* builtin_str_to_num(lenv*, lval*);
+lval* builtin_num_to_str(lenv*, lval*);
+
+#endif
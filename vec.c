@@ -0,0 +1,123 @@
+#include "lval.h"
+#include "lenv.h"
+#include "vec.h"
+#include "expressions.h"
+#include "common.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// takes items, count longs from malloc, over
+lval* lval_vec(long* items, long count)
+{
+	lval* v = lval_new(LVAL_VEC);
+	v->vec = malloc(sizeof(lvec));
+	v->vec->count = count;
+	v->vec->items = items;
+	return v;
+}
+
+lvec* lvec_copy(lvec* x)
+{
+	lvec* v = malloc(sizeof(lvec));
+	v->count = x->count;
+	v->items = malloc(sizeof(long) * x->count);
+	memcpy(v->items, x->items, sizeof(long) * x->count);
+	return v;
+}
+
+void lvec_del(lvec* v)
+{
+	free(v->items);
+	free(v);
+}
+
+/*
+ * Builtins
+ */
+
+// (vec-new {n ...})
+lval* builtin_vec_new(__attribute__((unused)) lenv* e, lval* a)
+{
+	LASSERT_NUM("vec-new", a, 1);
+	LASSERT_TYPE("vec-new", a, 0, LVAL_QEXPR);
+
+	lval* l = a->cell[0];
+	for (int i = 0; i < l->count; i++)
+	{
+		LASSERT(a, l->cell[i]->type == LVAL_NUM,
+			"Function 'vec-new' can only hold numbers, got %s at %i.",
+			ltype_name(l->cell[i]->type), i);
+	}
+
+	long* items = malloc(sizeof(long) * l->count);
+	for (int i = 0; i < l->count; i++)
+	{
+		items[i] = l->cell[i]->num;
+	}
+
+	lval* x = lval_vec(items, l->count);
+	lval_del(a);
+	return x;
+}
+
+// (vec-get v i), i from 0
+lval* builtin_vec_get(__attribute__((unused)) lenv* e, lval* a)
+{
+	LASSERT_NUM("vec-get", a, 2);
+	LASSERT_TYPE("vec-get", a, 0, LVAL_VEC);
+	LASSERT_TYPE("vec-get", a, 1, LVAL_NUM);
+
+	lvec* v = a->cell[0]->vec;
+	long i = a->cell[1]->num;
+	LASSERT(a, i >= 0 && i < v->count,
+		"Function 'vec-get' passed index %li, the vector has %li numbers.", i, v->count);
+
+	lval* x = lval_num(v->items[i]);
+	lval_del(a);
+	return x;
+}
+
+lval* builtin_vec_count(__attribute__((unused)) lenv* e, lval* a)
+{
+	LASSERT_NUM("vec-count", a, 1);
+	LASSERT_TYPE("vec-count", a, 0, LVAL_VEC);
+
+	lval* x = lval_num(a->cell[0]->vec->count);
+	lval_del(a);
+	return x;
+}
+
+lval* builtin_vec_sum(__attribute__((unused)) lenv* e, lval* a)
+{
+	LASSERT_NUM("vec-sum", a, 1);
+	LASSERT_TYPE("vec-sum", a, 0, LVAL_VEC);
+
+	lvec* v = a->cell[0]->vec;
+	long sum = 0;
+	for (long i = 0; i < v->count; i++)
+	{
+		sum += v->items[i];
+	}
+
+	lval_del(a);
+	return lval_num(sum);
+}
+
+// (vec->list v) the numbers of v as {n ...}
+lval* builtin_vec_to_list(__attribute__((unused)) lenv* e, lval* a)
+{
+	LASSERT_NUM("vec->list", a, 1);
+	LASSERT_TYPE("vec->list", a, 0, LVAL_VEC);
+
+	lvec* v = a->cell[0]->vec;
+	lval* x = lval_qexpr();
+	x->cell = malloc(sizeof(lval*) * v->count);
+	for (; x->count < v->count; x->count++)
+	{
+		x->cell[x->count] = lval_num(v->items[x->count]);
+	}
+
+	lval_del(a);
+	return x;
+}
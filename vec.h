@@ -0,0 +1,28 @@
+#ifndef VEC_H
+#define VEC_H
+
+typedef struct lval lval;
+typedef struct lenv lenv;
+
+/*
+ * Vectors of numbers, unboxed in one flat array instead of
+ * an lval per element. Nothing changes a vector once it is
+ * made, so copies share it.
+ */
+typedef struct lvec
+{
+	long count;
+	long* items;
+} lvec;
+
+lval* lval_vec(long*, long);
+lvec* lvec_copy(lvec*);
+void lvec_del(lvec*);
+
+lval* builtin_vec_new(lenv*, lval*);
+lval* builtin_vec_get(lenv*, lval*);
+lval* builtin_vec_count(lenv*, lval*);
+lval* builtin_vec_sum(lenv*, lval*);
+lval* builtin_vec_to_list(lenv*, lval*);
+
+#endif